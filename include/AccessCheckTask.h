@@ -0,0 +1,62 @@
+#ifndef ACCESSCHECKTASK_H
+#define ACCESSCHECKTASK_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include "ApiClient.h"
+#include "Models.h"
+#include "config.h"
+
+// One /access/check, owned by whoever holds the pointer
+struct AccessCheckJob {
+    uint32_t ticket;
+    AccessCheckRequest request;     // Self-contained: credential_bin already turned into credential_raw
+    AccessCheckResponse response;
+    bool success;
+    uint32_t startedMs;
+};
+
+// Runs /access/check on its own task and HTTP connection so loop() can
+// verify the credential locally meanwhile and stop waiting after a budget
+// (hedged decision). Checks queue up ACCESS_CHECK_QUEUE_DEPTH deep, so a
+// tap that opened on the local decision still reaches the server and a
+// slow answer does not turn the next tap away.
+class AccessCheckTask {
+public:
+    AccessCheckTask(ApiClient& api);
+    void begin();
+    void stop();
+    
+    // Queue a check. Returns its ticket, 0 if the queue is full
+    uint32_t submit(const AccessCheckRequest& request);
+    
+    // Finished job for ticket within timeoutMs, or NULL. Caller deletes it
+    AccessCheckJob* waitResult(uint32_t ticket, uint32_t timeoutMs);
+    
+    // A finished job other than keepTicket (still awaited by a tap), or NULL.
+    // Caller deletes it
+    AccessCheckJob* takeLate(uint32_t keepTicket = 0);
+    
+private:
+    ApiClient& api;
+    ApiConnection connection;   // Kept alive between taps
+    
+    TaskHandle_t taskHandle;
+    QueueHandle_t jobQueue;
+    QueueHandle_t resultQueue;
+    volatile bool running;
+    uint32_t nextTicket;
+    
+    // Answers taken off resultQueue that nobody has claimed yet
+    AccessCheckJob* finished[ACCESS_CHECK_QUEUE_DEPTH + 1];
+    int finishedCount;
+    
+    static void checkTaskFunction(void* param);
+    void checkLoop();
+    void keepFinished(AccessCheckJob* job);
+    AccessCheckJob* removeFinished(int index);
+};
+
+#endif
@@ -10,46 +10,135 @@
 #include "LCDDisplay.h"
 #include "BuzzerControl.h"
 #include "DoorSensor.h"
+#include "JWTVerifier.h"
+#include "VerifiedCredentialCache.h"
+#include "DecisionCache.h"
+#include "KeyRing.h"
+#include "OfflineStore.h"
+#include "AccessLogQueue.h"
+#include "AccessLogJournal.h"
 
 class DoorMonitoringTask;
+class NFCReaderTask;
+class AccessCheckTask;
+
+// Everything that exists once per door. LCD, buzzer and exit button are shared
+struct DoorChannel {
+    const char* doorId;
+    NFCReader* nfc;
+    RelayControl* relay;
+    DoorSensor* sensor;
+    DoorMonitoringTask* monitor;
+    AccessCheckTask* checkTask;     // Own connection, so doors are checked in parallel
+};
 
 class AccessController {
 public:
-    AccessController(NFCReader& nfc, ApiClient& api, RelayControl& relay,
-                     LCDDisplay& lcd, BuzzerControl& buzzer, DoorSensor& door,
-                     DoorMonitoringTask& doorMonitor);
+    AccessController(ApiClient& api, LCDDisplay& lcd, BuzzerControl& buzzer,
+                     NFCReaderTask& nfcTask, DoorChannel* doors, uint8_t doorCount);
     
-    void update();      
-    void handleCardTap(); 
-    void grantAccess(const String& reason = "ACCESS_GRANTED"); 
+    bool begin();       // Load persisted offline data (before WiFi)
+    void update();      // Steps the tap pipeline, never blocks on the network or timers
+    void handleCardTap(CardData* card);     // Takes ownership, finished by update()
+    void grantAccess(const String& reason = "ACCESS_GRANTED", uint8_t door = 0);
     
-    void updateConfig(const DeviceConfig& config);
+    void updateConfig(DeviceConfig& config);    // Takes over config.whitelist
     
-    void queueLog(const LogEntry& log);     
-    bool uploadQueuedLogs();                
+    void queueLog(uint8_t decision, const String& reason,    // ACCESS_LOG_ALLOW / ACCESS_LOG_DENY
+                  const String& card_id, const String& card_uid, uint8_t door = 0);
+    bool uploadQueuedLogs();                // Drain in LOG_BATCH_SIZE batches
+    int getQueuedLogCount() const;
+    uint32_t getDroppedLogCount() const;
+    void getVerifyCacheStats(uint32_t& hits, uint32_t& misses) const;
+    uint32_t getOfflineStoreGeneration() const;
     
 private:
-    NFCReader& nfc;
     ApiClient& api;
-    RelayControl& relay;
     LCDDisplay& lcd;
     BuzzerControl& buzzer;
-    DoorSensor& door;
-    DoorMonitoringTask& doorMonitor;
+    NFCReaderTask& nfcTask;
+    DoorChannel* doors;
+    uint8_t doorCount;
+    
+    // Một lần quẹt: read (NFC task) -> decide -> actuate -> write-back -> feedback
+    enum TapState {
+        TAP_IDLE,
+        TAP_DECIDING,       // Chờ server trả lời, loop vẫn chạy
+        TAP_WRITEBACK       // Cửa đã mở, ghi credential mới khi thẻ còn trên đầu đọc
+    };
+    
+    // Lần quẹt đang xử lý của một cửa, các cửa chạy song song
+    struct Tap {
+        uint8_t door;
+        TapState state;
+        CardData* card;             // Thẻ đang xử lý, giữ reader tới finishTap()
+        AccessCheckRequest request;
+        uint32_t ticket;            // Vé của AccessCheckTask, 0 = hàng đợi đầy, pollDecision() gửi lại
+        uint32_t startMs;
+        bool localAllow;            // Kết quả xác thực cục bộ trong lúc chờ server
+    };
+    Tap taps[DOOR_COUNT];
+    
+    // LCD dùng chung: giữ thông báo tới feedbackUntilMs rồi hiện feedbackNext
+    bool feedbackActive;
+    uint32_t feedbackUntilMs;
+    String feedbackNext1;
+    String feedbackNext2;
+    
+    // Credential mới chưa ghi được lên thẻ (thẻ rời đầu đọc), ghi lại ở lần quẹt sau
+    struct PendingWriteBack {
+        String card_id;         // Rỗng = ô trống
+        String card_uid;        // UID của thẻ nhận credential, thẻ khác cùng card_id thì bỏ
+        Credential credential;
+        uint32_t queuedMs;
+    };
+    PendingWriteBack pendingWrites[PENDING_WRITEBACK_SLOTS];
+    
+    // Vé của các lần quẹt đã mở cửa theo quyết định cục bộ, chờ server trả lời để đối chiếu
+    uint32_t hedgedTickets[DOOR_COUNT][ACCESS_CHECK_QUEUE_DEPTH];
+    uint8_t hedgedNext[DOOR_COUNT];
     
     // Danh sách offline (Whitelist)
-    OfflineWhitelistItem whitelist[50];
-    int whitelistCount;
-    String jwtPublicKeyPem;  
+    OfflineWhitelist whitelist;
+    OfflineStore store;         // Bản lưu flash của whitelist + khóa, còn sau khi mất điện
+    KeyRing keyRing;            // Khóa parse sẵn từ PEM khi nhận config, tra theo kid
+    JWTVerifier verifier;       // Giữ buffer giải mã ngoài stack của loop()
+    VerifiedCredentialCache verifiedCache;  // Credential đã xác thực chữ ký (offline)
+    DecisionCache decisionCache;            // Kết quả online gần đây, cho lần quẹt lặp lại
+    
+    AccessLogQueue logQueue;    // Nhật ký chờ gửi, bản ghi nhị phân cố định
+    AccessLogJournal journal;   // Nhật ký trên flash, giữ lại qua mất điện cho tới khi server xác nhận
     
-    LogEntry logQueue[LOG_QUEUE_SIZE];
-    int logQueueCount;
+    uint32_t lastLogMs;
+    uint32_t lastUploadFailMs;
+    bool uploadFailed;
     
-    void handleBlankCard(const String& card_uid);   
-    void handleCardWithId(const CardData& card);    
+    void flushLogs();
+    void scheduleLogUpload();
+    bool uploadLogBatch(bool moreToFollow, int& sent);
+    void handleBlankCard(Tap& tap);
+    void handleCardWithId(Tap& tap);
+    void pollDecision(Tap& tap);
+    void applyDecision(Tap& tap, bool apiSuccess, AccessCheckResponse& response);
+    void decideOffline(Tap& tap);
+    void grantTapAccess(Tap& tap, const String& reason);
+    void completeTap(Tap& tap, const Credential* fresh);
+    void writeBack(Tap& tap);
+    void finishTap(Tap& tap);
+    void rememberWriteBack(const String& card_id, const String& card_uid, const Credential& credential);
+    int findWriteBack(const String& card_id, const String& card_uid);
+    void forgetWriteBack(const String& card_id);
+    bool needsCredentialWrite(const CardData& card, const Credential& credential);
+    void showFeedback(const String& line1, const String& line2, uint32_t holdMs,
+                      const String& next1, const String& next2);
     bool checkOfflineWhitelist(const String& card_id, const CardData& card); 
-    LogEntry createLog(const String& decision, const String& reason, 
-                       const String& card_id, const String& card_uid); 
+    void reconcileLateChecks();
+    void rememberHedge(uint8_t door, uint32_t ticket);
+    bool takeHedge(uint8_t door, uint32_t ticket);
+    bool applyCachedDecision(Tap& tap);
+    void loadKeyRing(const JwtVerificationConfig* keys, int keyCount);
+    static uint8_t keyAlg(const JwtVerificationConfig& key);
+    bool isSameCredential(const CardData& card, const Credential& credential);
 };
 
 #endif
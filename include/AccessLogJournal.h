@@ -0,0 +1,69 @@
+#ifndef ACCESSLOGJOURNAL_H
+#define ACCESSLOGJOURNAL_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "AccessLogQueue.h"
+#include "config.h"
+
+// Append-only access log on LittleFS, so decisions made offline survive a
+// power cut or restart until the backend has acknowledged them.
+//
+// ACCESS_LOG_DIR holds:
+//   <id>.seg   raw AccessLogRecord, ACCESS_LOG_SEGMENT_RECORDS per file
+//   cursor     last seq acknowledged by the backend
+//   reasons    reason table of the AccessLogQueue, one per line
+//   boot       boot counter, stamped into records so uptime timestamps
+//              from an earlier boot are never placed on this boot's clock
+// Records are appended in batches from the RAM queue after the tap is
+// handled. A segment is deleted as a whole once everything in it is
+// acknowledged; when ACCESS_LOG_MAX_SEGMENTS are in use the oldest one is
+// dropped even if not uploaded.
+//
+// Used from the loop() thread only.
+class AccessLogJournal {
+public:
+    AccessLogJournal();
+    
+    // Mount, scan segments, restore numbering, reason codes and boot counter into queue
+    bool begin(AccessLogQueue& queue);
+    bool isReady() const;
+    
+    bool append(const AccessLogRecord* records, int count, const AccessLogQueue& queue);
+    
+    // Oldest unacknowledged records as log-batch JSON, same contract as AccessLogQueue::toJson
+    int toJson(JsonArray out, int maxCount, uint32_t& lastSeq, const AccessLogQueue& queue);
+    void acknowledge(uint32_t seq);
+    
+    // Upper bound (sequence gaps are counted)
+    uint32_t pendingCount() const;
+    
+private:
+    struct Segment {
+        uint32_t id;
+        uint32_t firstSeq;
+        uint32_t lastSeq;
+        uint32_t records;
+        bool sealed;        // Torn or failed write, append to a new segment
+    };
+    
+    Segment segments[ACCESS_LOG_MAX_SEGMENTS];    // Oldest first
+    int segmentCount;
+    uint32_t ackedSeq;
+    uint32_t lastSeq;
+    int savedReasons;
+    bool ready;
+    
+    bool scanSegments();
+    bool startSegment();
+    void dropOldestSegment();
+    void compact();
+    bool saveCursor();
+    uint32_t nextBoot();
+    bool saveReasons(const AccessLogQueue& queue);
+    int loadReasons(String* names, int maxNames);
+    static String segmentPath(uint32_t id);
+    static bool replaceFile(const char* path, const uint8_t* data, size_t len);
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef ACCESSLOGQUEUE_H
+#define ACCESSLOGQUEUE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "config.h"
+
+#define ACCESS_LOG_CARD_ID_LEN 38   // NFC_CARD_ID_MAX_LEN: longest card_id a card can hold
+#define ACCESS_LOG_UID_LEN 10       // MFRC522 UIDs are 4, 7 or 10 bytes
+#define ACCESS_LOG_REASON_MAX 32    // Distinct reason strings kept
+#define ACCESS_LOG_REASON_LEN 32
+
+#define ACCESS_LOG_DENY 0
+#define ACCESS_LOG_ALLOW 1
+
+// One access decision, 64 bytes, no heap. The door and the reason are
+// indexes into the queue's door_id and reason tables.
+struct AccessLogRecord {
+    uint32_t seq;           // Increasing, used to acknowledge uploads
+    uint32_t ts;            // Epoch seconds, or uptime seconds of boot if !clockSet
+    uint8_t decision : 1;   // ACCESS_LOG_*
+    uint8_t door : 7;       // Index into the door_id table
+    uint8_t reason;
+    uint8_t cardIdLen;
+    uint8_t uidLen : 7;
+    uint8_t clockSet : 1;
+    char cardId[ACCESS_LOG_CARD_ID_LEN];
+    uint8_t uid[ACCESS_LOG_UID_LEN];
+    uint16_t boot;          // Boot counter (AccessLogJournal) when the record was made
+    uint16_t reserved;
+};
+
+// Fixed ring of AccessLogRecord. When full the oldest record is
+// overwritten. push() is O(1) and may be called from any task; JSON is
+// only produced by toJson() at upload time.
+class AccessLogQueue {
+public:
+    AccessLogQueue();
+    
+    void push(uint8_t decision, const String& reason, const String& cardId, const String& cardUid,
+              uint8_t door = 0);
+    
+    // Append up to maxCount of the oldest records to out. lastSeq receives the
+    // seq of the last one written, to pass to release() once uploaded
+    int toJson(JsonArray out, int maxCount, uint32_t& lastSeq) const;
+    
+    // Drop records up to and including seq (records pushed since stay)
+    void release(uint32_t seq);
+    
+    // Copy up to maxCount of the oldest records without removing them
+    int peek(AccessLogRecord* out, int maxCount) const;
+    
+    // One record as a log-batch JSON object (records read back from flash)
+    void appendJson(JsonArray out, const AccessLogRecord& record) const;
+    
+    int count() const;
+    uint32_t getDropped() const;    // Overwritten before reaching flash, since boot
+    
+    // Persistence (AccessLogJournal): numbering and reason codes must carry
+    // over a reboot. Call before the first push()
+    void setNextSeq(uint32_t seq);
+    void setBoot(uint16_t boot);
+    void loadReasons(const String* names, int count);
+    int getReasonCount() const;
+    const char* getReason(uint8_t code) const;
+    
+    // door_id sent for records of each door (door 0 defaults to DOOR_ID)
+    void setDoorId(uint8_t door, const char* doorId);
+    
+private:
+    AccessLogRecord records[LOG_QUEUE_SIZE];
+    int head;               // Oldest record
+    int used;
+    uint32_t nextSeq;
+    uint32_t dropped;
+    uint16_t boot;
+    
+    // Interned reasons, index 0 is the fallback when the table is full
+    char reasons[ACCESS_LOG_REASON_MAX][ACCESS_LOG_REASON_LEN];
+    int reasonCount;
+    
+    const char* doorIds[DOOR_COUNT];
+    
+    mutable SemaphoreHandle_t lock;
+    
+    uint8_t internReason(const String& reason);
+    bool formatTime(const AccessLogRecord& record, char* out, size_t maxLen) const;
+};
+
+#endif
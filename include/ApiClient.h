@@ -7,8 +7,20 @@
 #include <ArduinoJson.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <atomic>
 #include "Models.h"
 
+// HTTP connection for requests made from another task; the client inside
+// ApiClient belongs to loop()
+struct ApiConnection {
+    WiFiClientSecure secureClient;
+    HTTPClient http;
+    
+    ApiConnection() {
+        secureClient.setInsecure();
+    }
+};
+
 class ApiClient {
 public:
     ApiClient(const char* baseUrl);
@@ -22,9 +34,12 @@ public:
     bool sendHeartbeat(const DeviceStatus& status);
     
     // Access APIs
-    bool checkAccess(const AccessCheckRequest& request, AccessCheckResponse& outResponse);
+    bool checkAccess(const AccessCheckRequest& request, AccessCheckResponse& outResponse,
+                     ApiConnection* connection = nullptr);
     bool createCard(const CardCreateRequest& request, CardCreateResponse& outResponse);
-    bool uploadLogs(LogEntry* logs, int count);
+    // requestDoc["logs"] filled by the caller. keepAlive: another batch follows,
+    // keep the connection open for it
+    bool uploadLogs(JsonDocument& requestDoc, bool keepAlive = false);
     
     // Door Command Polling (Remote Control)
     bool pollDoorCommand(const String& doorId, DoorCommandPollResponse& outResponse);
@@ -42,12 +57,15 @@ public:
 private:
     String baseUrl;
     String deviceToken;
-    int consecutiveFailures;
+    SemaphoreHandle_t tokenLock;    // deviceToken is read by every task that calls the API
+    // Written by loop(), AccessCheckTask and CommandPollingTask, read by NFCReaderTask
+    std::atomic<int> consecutiveFailures;
     WiFiClientSecure secureClient;
     HTTPClient http;
     
-    bool post(const char* endpoint, const JsonDocument& requestDoc, JsonDocument& responseDoc);
-    bool get(const char* endpoint, JsonDocument& responseDoc);
+    bool post(const char* endpoint, const JsonDocument& requestDoc, JsonDocument& responseDoc,
+              ApiConnection* connection = nullptr);
+    bool get(const char* endpoint, JsonDocument& responseDoc, OfflineWhitelist* whitelist = nullptr);
     void recordFailure();
     void recordSuccess();
 };
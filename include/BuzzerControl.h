@@ -2,23 +2,42 @@
 #define BUZZERCONTROL_H
 
 #include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
+// One step of a feedback pattern, freq 0 = silence
+struct BuzzerNote {
+    uint16_t freq;
+    uint16_t ms;
+};
+
+// accessGranted/accessDenied only start a pattern, update() (called from
+// loop) steps through it. The alarm is driven from the door monitoring
+// task and always wins over a pattern.
 class BuzzerControl {
 public:
     BuzzerControl(uint8_t pin, uint8_t channel);
     void begin();
+    void update();
     void accessGranted();
     void accessDenied();
     void startAlarm();
     void stopAlarm();
     bool isAlarmActive() const;
-    void toneTimed(uint32_t frequency, uint32_t durationMs);
+    void toneTimed(uint32_t frequency, uint32_t durationMs);    // Blocking
     
 private:
     uint8_t pin;
     uint8_t channel;
     bool alarmActive;
     
+    const BuzzerNote* pattern;
+    uint8_t patternLen;
+    uint8_t step;
+    uint32_t stepStartMs;
+    SemaphoreHandle_t lock;
+    
+    void play(const BuzzerNote* notes, uint8_t count);
     void tone(uint32_t frequency);
     void off();
 };
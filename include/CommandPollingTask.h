@@ -11,10 +11,12 @@
 #include "RelayControl.h"
 #include "config.h"
 
+// Long-polls remote commands for one door, one task per DoorChannel so a
+// door waiting on the server does not hold up the others
 class CommandPollingTask {
 public:
     CommandPollingTask(ApiClient& api, AccessController& access, 
-                       LCDDisplay& lcd, RelayControl& relay);
+                       LCDDisplay& lcd, const DoorChannel& door, uint8_t doorIndex);
     
     void begin();
     void stop();
@@ -25,7 +27,8 @@ private:
     ApiClient& api;
     AccessController& access;
     LCDDisplay& lcd;
-    RelayControl& relay;
+    const DoorChannel& door;
+    uint8_t doorIndex;
     
     TaskHandle_t taskHandle;
     volatile bool running;
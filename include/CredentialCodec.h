@@ -0,0 +1,77 @@
+#ifndef CREDENTIALCODEC_H
+#define CREDENTIALCODEC_H
+
+#include <Arduino.h>
+#include "Models.h"
+
+// Compact on-card credential layout (v1, little endian):
+//   [0]      magic CREDENTIAL_COMPACT_MAGIC
+//   [1]      alg id (CREDENTIAL_ALG_*)
+//   [2]      header length H
+//   [3..4]   payload length P
+//   [5..68]  raw signature (64 bytes)
+//   [69..]   header JSON (H bytes), then payload JSON (P bytes)
+//
+// Header and payload are kept byte-exact so the signed form
+// base64url(header) "." base64url(payload) can always be rebuilt.
+#define CREDENTIAL_COMPACT_MAGIC 0xC1
+#define CREDENTIAL_COMPACT_FIXED_LEN 69
+#define CREDENTIAL_SIGNATURE_LEN 64
+
+// Longest "header.payload" text a card credential can expand to
+#define CREDENTIAL_SIGNING_INPUT_MAX ((CREDENTIAL_MAX_BYTES - CREDENTIAL_COMPACT_FIXED_LEN + 2) / 3 * 4 + 1)
+
+#define CREDENTIAL_ALG_UNKNOWN 0
+#define CREDENTIAL_ALG_EDDSA 1
+#define CREDENTIAL_ALG_ES256 2
+
+struct CompactCredential {
+    uint8_t alg;
+    const uint8_t* signature;   // 64 bytes
+    const uint8_t* header;      // Header JSON
+    uint16_t headerLen;
+    const uint8_t* payload;     // Claims JSON
+    uint16_t payloadLen;
+};
+
+class CredentialCodec {
+public:
+    // True if the buffer starts with the compact layout magic
+    static bool isCompact(const uint8_t* data, size_t len);
+    
+    // JWT text -> compact bytes. Returns bytes written, 0 on failure
+    static size_t encode(const String& jwt, uint8_t* out, size_t maxLen);
+    
+    // Compact bytes -> views into the buffer (no copy). len must be the exact
+    // encoded length, trailing bytes are rejected
+    static bool parse(const uint8_t* data, size_t len, CompactCredential& out);
+    
+    // Rebuild "header.payload" (the JWS signing input) into out.
+    // Returns chars written (no terminator), 0 if it does not fit
+    static size_t signingInput(const CompactCredential& cred, char* out, size_t maxLen);
+    
+    // Rebuild the canonical "header.payload.signature" JWT
+    static String toJwt(const CompactCredential& cred);
+    
+    // "kid" from the JWS header of a stored credential (compact or text).
+    // Returns its length, 0 if absent, malformed or longer than maxLen - 1
+    static size_t headerKid(const uint8_t* data, size_t len, char* out, size_t maxLen);
+    
+    // JWS alg name ("EdDSA", "ES256") -> CREDENTIAL_ALG_*
+    static uint8_t algFromName(const char* name);
+    static uint8_t algFromHeader(const uint8_t* header, size_t len);
+    
+    // FNV-1a over the stored bytes, kept in the card header to detect
+    // torn writes and to identify a credential without reading it
+    static uint32_t hash(const uint8_t* data, size_t len);
+    
+    static size_t base64UrlEncodedLength(size_t len);
+    static size_t base64UrlEncode(const uint8_t* input, size_t len, char* output);
+    static size_t base64UrlDecode(const char* input, size_t len, uint8_t* output, size_t maxLen);
+    
+private:
+    static size_t kidFromHeader(const uint8_t* header, size_t len, char* out, size_t maxLen);
+    static void appendBase64Url(String& out, const uint8_t* data, size_t len);
+};
+
+#endif
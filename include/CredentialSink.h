@@ -0,0 +1,13 @@
+#ifndef CREDENTIALSINK_H
+#define CREDENTIALSINK_H
+
+#include <Arduino.h>
+
+// Receives credential bytes in order, as each block comes off the card
+class CredentialSink {
+public:
+    virtual ~CredentialSink() {}
+    virtual void onCredentialBytes(const uint8_t* data, size_t len) = 0;
+};
+
+#endif
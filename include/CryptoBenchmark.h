@@ -0,0 +1,20 @@
+#ifndef CRYPTOBENCHMARK_H
+#define CRYPTOBENCHMARK_H
+
+#include <Arduino.h>
+
+// Times EdDSA vs ES256 signature verification on this chip, over the
+// same signing input, with throwaway keys generated at run time. EdDSA is
+// timed on both the software and the hardware SHA-512 path.
+// Used to pick the fleet algorithm; enable with ENABLE_CRYPTO_BENCHMARK.
+class CryptoBenchmark {
+public:
+    static void run(int iterations);
+    
+private:
+    static uint32_t benchEdDSA(const uint8_t* message, size_t len, int iterations, uint32_t& hwShaUs);
+    static void benchSHA512(const uint8_t* message, size_t len, int iterations);
+    static uint32_t benchES256(const uint8_t* message, size_t len, int iterations);
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef DECISIONCACHE_H
+#define DECISIONCACHE_H
+
+#include <Arduino.h>
+#include "Models.h"
+#include "config.h"
+
+#define DECISION_CACHE_KEY_LEN 32
+
+// Recent online ALLOW/DENY answers, reused for repeat taps of the same card
+// while their TTL lasts. The TTL comes from the server (cache_ttl_sec),
+// capped on the device; answers without one are not cached.
+// Key = SHA-256(card_id || UID || door_id || credential), so a card carrying
+// a different credential than the one the server judged, or tapped at
+// another door, never hits.
+class DecisionCache {
+public:
+    DecisionCache();
+    
+    static void makeKey(const AccessCheckRequest& request, uint8_t outKey[DECISION_CACHE_KEY_LEN]);
+    
+    bool lookup(const uint8_t key[DECISION_CACHE_KEY_LEN], bool& allow, String& userName);
+    void insert(const uint8_t key[DECISION_CACHE_KEY_LEN], const AccessCheckResponse& response);
+    void clear();
+    
+    // Server-side cap from the device config, -1 = DECISION_CACHE_MAX_TTL_MS
+    void setMaxTtl(int maxTtlSec);
+    
+private:
+    struct Entry {
+        uint8_t key[DECISION_CACHE_KEY_LEN];
+        bool allow;
+        String userName;    // For the LCD greeting
+        uint32_t storedMs;
+        uint32_t ttlMs;     // 0 = empty slot
+    };
+    
+    Entry entries[DECISION_CACHE_SIZE];
+    uint32_t maxTtlMs;
+    
+    static bool isLive(const Entry& entry, uint32_t now);
+};
+
+#endif
@@ -41,6 +41,8 @@ private:
     unsigned long doorCloseTime;
     bool lastDoorOpen;
     bool alarmTriggered;
+    unsigned long lastIdleUpdate;
+    int lastDisplayedSec;
     
     static void monitoringTaskFunction(void* param);
     void monitorLoop();
@@ -3,6 +3,8 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <mbedtls/pk.h>
+#include "CredentialCodec.h"
 
 struct JWTPayload {
     String card_id;
@@ -14,17 +16,55 @@ struct JWTPayload {
     bool valid;
 };
 
+#define JWT_PUBLIC_KEY_MAX_LEN 65
+
+// Public key parsed once from the config PEM, ready for verification.
+// Owns an mbedTLS context for ES256: do not copy, release with freePublicKey
+struct JWTPublicKey {
+    uint8_t alg;                            // CREDENTIAL_ALG_*
+    uint8_t key[JWT_PUBLIC_KEY_MAX_LEN];    // Ed25519: 32 raw bytes, ES256: uncompressed P-256 point
+    uint8_t keyLen;
+    mbedtls_pk_context* pk;                 // ES256 only, curve and point loaded once
+    bool valid;
+};
+
 class JWTVerifier {
 public:
     JWTVerifier();
     
+    // PEM (SPKI) -> key for alg (CREDENTIAL_ALG_*). Call when the config changes, not per tap
+    static bool parsePublicKey(const String& publicKeyPem, uint8_t alg, JWTPublicKey& outKey);
+    static void freePublicKey(JWTPublicKey& key);
+    
     // Verify JWT signature and extract payload
-    bool verify(const String& jwt, const String& publicKeyPem, JWTPayload& outPayload);
+    bool verify(const String& jwt, const JWTPublicKey& key, JWTPayload& outPayload);
+    bool verify(const char* token, size_t len, const JWTPublicKey& key, JWTPayload& outPayload);
+    
+    // Verify compact binary credential as stored on the card
+    bool verifyCompact(const uint8_t* data, size_t len, const JWTPublicKey& key, JWTPayload& outPayload);
+    
+    // Same for ES256, with SHA-256 of the signing input already taken while
+    // the card was read (StreamingVerifier)
+    bool verifyCompactDigest(const uint8_t* data, size_t len, const uint8_t* digest,
+                             const JWTPublicKey& key, JWTPayload& outPayload);
     
 private:
-    int base64UrlDecode(const String& input, uint8_t* output, int maxLen);
-    bool verifyEdDSASignature(const String& message, const String& signature, const String& publicKeyPem);
-    bool parsePayload(const String& payloadJson, JWTPayload& outPayload);
+    // Work buffers live in the verifier, not on the caller's stack
+    uint8_t payloadBuffer[CREDENTIAL_MAX_BYTES];
+    char messageBuffer[CREDENTIAL_SIGNING_INPUT_MAX];
+    JsonDocument claimsFilter;
+    
+    // Dispatch on the header alg, which must match the key's
+    bool verifySignature(uint8_t alg, const uint8_t* message, size_t messageLen,
+                         const uint8_t signature[64], const JWTPublicKey& key);
+    bool verifyEdDSASignature(const uint8_t* message, size_t messageLen, const uint8_t signature[64], const JWTPublicKey& key);
+    bool verifyES256Signature(const uint8_t* message, size_t messageLen, const uint8_t signature[64], const JWTPublicKey& key);
+    bool verifyES256Digest(const uint8_t digest[32], const uint8_t signature[64], const JWTPublicKey& key);
+    
+    static size_t decodePem(const String& publicKeyPem, uint8_t* out, size_t maxLen);
+    static bool parseEd25519Key(const uint8_t* der, size_t derLen, JWTPublicKey& outKey);
+    static bool parseES256Key(const uint8_t* der, size_t derLen, JWTPublicKey& outKey);
+    bool parsePayload(const char* payloadJson, size_t len, JWTPayload& outPayload);
 };
 
 #endif
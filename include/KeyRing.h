@@ -0,0 +1,53 @@
+#ifndef KEYRING_H
+#define KEYRING_H
+
+#include <Arduino.h>
+#include "JWTVerifier.h"
+#include "config.h"
+
+// Pre-parsed verification keys indexed by kid. The current key has no
+// expiry; retired keys stay usable until the server-supplied expires_at
+// so cards signed before a rotation keep working offline.
+class KeyRing {
+public:
+    KeyRing();
+    ~KeyRing();
+    
+    void clear();
+    
+    // Parse and index a key for alg (CREDENTIAL_ALG_*). expiresAt is epoch seconds,
+    // 0 = no expiry, accepted for the default key only
+    bool add(const String& kid, uint8_t alg, const String& publicKeyPem, uint32_t expiresAt, bool isDefault);
+    
+    // Key for a JWT header kid (kidLen 0 = no kid, uses the default key; an
+    // unknown kid also does when the default key was configured without one).
+    // NULL if unknown or expired at now (epoch seconds, 0 if clock unset)
+    const JWTPublicKey* find(const char* kid, size_t kidLen, uint32_t now) const;
+    
+    // Epoch seconds, 0 until NTP has synced (time() counts from boot before that)
+    static uint32_t clockNow();
+    
+    int getCount() const;
+    
+private:
+    struct Slot {
+        uint32_t kidHash;
+        char kid[JWT_KID_MAX_LEN + 1];
+        uint8_t kidLen;
+        uint32_t expiresAt;
+        JWTPublicKey key;
+        bool used;
+    };
+    
+    // Open addressing, twice the key count so probes stay short
+    static const int TABLE_SIZE = JWT_KEYRING_SIZE * 2;
+    
+    Slot slots[TABLE_SIZE];
+    int defaultSlot;
+    int count;
+    
+    int findSlot(const char* kid, size_t kidLen, uint32_t kidHash) const;
+    bool isUsable(const Slot& slot, uint32_t now) const;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Log levels
+#define LOG_LEVEL_NONE    0
+#define LOG_LEVEL_ERROR   1
+#define LOG_LEVEL_WARN    2
+#define LOG_LEVEL_INFO    3
+#define LOG_LEVEL_DEBUG   4
+#define LOG_LEVEL_VERBOSE 5
+
+// Usage, in a .cpp only (never from a header):
+//   #define LOG_MODULE_LEVEL LOG_LEVEL_NFC
+//   #include "Log.h"
+//   LOG_I("NFC", "Read %d bytes", len);
+//
+// A call above the module's compile-time level is a constant-false branch,
+// so the call, its format string and its arguments are dropped by the
+// compiler. Calls that survive are still filtered by the runtime level.
+class Log {
+public:
+    static void setLevel(uint8_t level);
+    static uint8_t getLevel();
+    
+    // "error", "warn", "info", "debug", "verbose" or a digit
+    static int parseLevel(const char* name);
+    
+    static uint8_t level;
+};
+
+#define LOG_ENABLED(lvl) ((lvl) <= LOG_MODULE_LEVEL && (lvl) <= Log::level)
+
+#define LOG_AT(lvl, tag, fmt, ...) \
+    do { \
+        if (LOG_ENABLED(lvl)) Serial.printf("[" tag "] " fmt "\n", ##__VA_ARGS__); \
+    } while (0)
+
+#define LOG_E(tag, fmt, ...) LOG_AT(LOG_LEVEL_ERROR, tag, fmt, ##__VA_ARGS__)
+#define LOG_W(tag, fmt, ...) LOG_AT(LOG_LEVEL_WARN, tag, fmt, ##__VA_ARGS__)
+#define LOG_I(tag, fmt, ...) LOG_AT(LOG_LEVEL_INFO, tag, fmt, ##__VA_ARGS__)
+#define LOG_D(tag, fmt, ...) LOG_AT(LOG_LEVEL_DEBUG, tag, fmt, ##__VA_ARGS__)
+#define LOG_V(tag, fmt, ...) LOG_AT(LOG_LEVEL_VERBOSE, tag, fmt, ##__VA_ARGS__)
+
+#endif
@@ -2,12 +2,16 @@
 #define MODELS_H
 
 #include <Arduino.h>
+#include "config.h"
+#include "OfflineWhitelist.h"
 
 // ============================================
 // Cấu trúc dữ liệu thẻ
 // ============================================
+#define CREDENTIAL_MAX_BYTES 478  // 30 block x 16 byte - 2 byte độ dài
+
 struct Credential {
-    String format;      // "jwt"
+    String format;      // "jwt" (text) hoặc "jwt-bin" (dạng nhị phân gọn trên thẻ)
     String alg;         // Thuật toán mã hóa ("EdDSA" hoặc "ES256")
     String raw;         // Chuỗi JWT đầy đủ
     String exp;         // Thời gian hết hạn
@@ -17,23 +21,30 @@ struct CardData {
     String card_id;     // ID thẻ trong hệ thống (backend cấp)
     String card_uid;    // UID phần cứng của thẻ (từ chip NFC)
     Credential credential;
+    uint8_t credential_bin[CREDENTIAL_MAX_BYTES];  // Dữ liệu credential đọc nguyên từ thẻ
+    uint16_t credential_bin_len;
+    uint16_t credential_len;    // Độ dài credential theo header thẻ
+    uint32_t credential_hash;   // Hash credential theo header thẻ
     bool has_card_id;
     bool has_credential;
+    bool has_header;            // Thẻ có header (layout mới)
+    bool header_unreadable;     // Header lỗi đọc / phiên bản lạ: từ chối, không enroll
+    uint32_t detected_ms;       // millis() lúc phát hiện thẻ
+    uint8_t door;               // Cửa có đầu đọc phát hiện thẻ (0 .. DOOR_COUNT - 1)
+    
+    // Hash của signing input, tính dần trong lúc đọc block (offline, credential ES256 dạng gọn)
+    bool has_signing_digest;
+    uint8_t signing_digest[32];     // SHA-256(M)
 };
 
 // ============================================
 // Cấu hình thiết bị
 // ============================================
-struct OfflineWhitelistItem {
-    String card_id;
-    String user_id;
-    String valid_until;
-};
-
 struct JwtVerificationConfig {
     String alg;             // Thuật toán ("EdDSA" hoặc "ES256")
     String public_key_pem;  // Khóa công khai (Public Key) dạng PEM
     String kid;             // Key ID (tùy chọn)
+    uint32_t expires_at;    // Khóa cũ: dùng được đến thời điểm này (epoch), 0 = không hết hạn
 };
 
 struct OfflineModeConfig {
@@ -44,10 +55,13 @@ struct OfflineModeConfig {
 struct DeviceConfig {
     String device_id;
     int relay_open_ms;
+    int log_level;          // Mức log runtime từ backend (-1 nếu không có)
+    int decision_cache_max_ttl_sec;  // Giới hạn TTL cache kết quả online (-1 nếu không có)
     OfflineModeConfig offline_mode;
     JwtVerificationConfig jwt_verification;
-    OfflineWhitelistItem whitelist[50];  // Lưu tối đa 50 người khi mất mạng
-    int whitelist_count;
+    JwtVerificationConfig jwt_retired_keys[JWT_KEYRING_SIZE - 1];  // Khóa cũ sau khi xoay khóa
+    int jwt_retired_key_count;
+    OfflineWhitelist whitelist;  // Danh sách dùng khi mất mạng (parse trực tiếp từ response)
 };
 
 // ============================================
@@ -59,6 +73,11 @@ struct AccessCheckRequest {
     String card_id;
     String card_uid;
     String credential_raw;  // Chuỗi JWT (để trống nếu thẻ trắng)
+    const uint8_t* credential_bin;  // Credential nhị phân trên thẻ (dựng lại JWT khi gửi)
+    uint16_t credential_bin_len;
+    bool credential_hash_only;      // Chỉ gửi hash (chưa đọc credential từ thẻ)
+    uint32_t credential_hash;
+    uint16_t credential_len;
     String timestamp;
 };
 
@@ -76,6 +95,7 @@ struct AccessCheckResponse {
     String result;          // "ALLOW" (cho vào) hoặc "DENY" (cấm)
     String reason;          // Lý do
     int relay_open_ms;
+    int cache_ttl_sec;      // Thời gian thiết bị được dùng lại kết quả này (0 = không cache)
     UserInfo user;
     PolicyInfo policy;
     Credential credential;  // Credential mới từ backend (nếu có)
@@ -97,18 +117,6 @@ struct CardCreateResponse {
     bool enroll_mode;       // Chế độ đăng ký thẻ mới
 };
 
-// ============================================
-// Nhật ký hoạt động (Log)
-// ============================================
-struct LogEntry {
-    String ts;          // Thời gian (ISO 8601)
-    String door_id;
-    String card_id;
-    String card_uid;
-    String decision;    // Kết quả ("ALLOW" / "DENY")
-    String reason;      // Lý do
-};
-
 // ============================================
 // Trạng thái thiết bị (Heartbeat)
 // ============================================
@@ -117,6 +125,11 @@ struct DeviceStatus {
     int rssi;           // Cường độ sóng Wifi
     String fw_version;  // Phiên bản phần mềm
     String last_access_ts;
+    uint32_t verify_cache_hits;     // Số lần bỏ qua xác thực chữ ký nhờ cache (offline)
+    uint32_t verify_cache_misses;
+    uint32_t loop_stack_free;       // Stack loop() còn trống thấp nhất từ lúc khởi động (byte)
+    uint32_t logs_dropped;          // Nhật ký bị ghi đè trong RAM trước khi kịp lưu flash (từ lúc khởi động)
+    uint32_t offline_store_gen;     // Thế hệ bản lưu whitelist + khóa trên flash, 0 = chưa có
 };
 
 // ============================================
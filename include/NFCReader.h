@@ -3,15 +3,34 @@
 
 #include <Arduino.h>
 #include <MFRC522.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "CredentialSink.h"
 #include "Models.h"
 
+// Card layout (MIFARE Classic 1K)
+// Sector 1 (blocks 4-6): 10-byte header followed by card_id
+#define NFC_HEADER_BLOCK 4
+#define NFC_CARD_ID_START_BLOCK 4
+#define NFC_CARD_ID_BLOCKS 3
+#define NFC_CARD_HEADER_MAGIC 0xCA
+#define NFC_CARD_LAYOUT_VERSION 1
+#define NFC_CARD_HEADER_LEN 10
+#define NFC_CARD_ID_MAX_LEN (NFC_CARD_ID_BLOCKS * 16 - NFC_CARD_HEADER_LEN)
+#define NFC_CREDENTIAL_START_BLOCK 8
+#define NFC_CREDENTIAL_BLOCKS 30
+
 class NFCReader {
 public:
-    NFCReader(uint8_t ssPin, uint8_t rstPin);
+    NFCReader(uint8_t ssPin, uint8_t rstPin, int irqPin = -1);
+    void deselect();    // SS high, before any reader on the shared bus is initialized
     void begin();
     bool isCardPresent();
+    void setWakeTask(TaskHandle_t task);    // Notified from the ISR when a card answers
     bool reconnect();
     CardData readCard();
+    CardData readCardHeader();               // Header + card_id only (one sector)
+    bool readCredential(CardData& card, CredentialSink* sink = nullptr);  // Credential blocks, checked against header
     bool writeCardId(const String& cardId);
     bool writeCredential(const Credential& credential);
     bool clearCardId();
@@ -23,11 +42,55 @@ private:
     MFRC522 mfrc;
     uint8_t ssPin;
     uint8_t rstPin;
+    int irqPin;             // -1 = polling mode
     uint32_t lastReadTime;
     
+    // IRQ detection: REQA is sent periodically, ISR fires when a card answers
+    volatile bool irqPending;
+    bool irqArmed;
+    uint32_t lastArmTime;
+    TaskHandle_t wakeTask;
+    
+    // Sector currently authenticated with Crypto1 (-1 = none)
+    int authSector;
+    
+    // Timing breakdown for [PERF] logs
+    uint32_t authUs;
+    uint32_t ioUs;
+    uint16_t authCount;
+    uint16_t ioCount;
+    
+    // Raw credential blocks as last read/written, for delta writes
+    uint8_t credentialImage[NFC_CREDENTIAL_BLOCKS * 16];
+    int credentialImageBlocks;
+    String credentialImageUid;
+    
+    // Header sector as last read/written
+    uint8_t headerImage[NFC_CARD_ID_BLOCKS * 16];
+    int headerImageBlocks;
+    String headerImageUid;
+    String headerCardId;
+    
+    static void onIrq(void* arg);
+    void armIrq();
+    bool pollIrq(uint32_t now);
     String uidToString(const MFRC522::Uid& uid);
-    String readNdefText(int startBlock, int numBlocks);
+    bool authenticateBlock(int block);
+    void resetAuth();
+    void resetPerf();
+    void printPerf(const char* op);
+    int readNdefBytes(int startBlock, int numBlocks, uint8_t* out, size_t maxLen,
+                      uint8_t* image = nullptr, int* imageBlocks = nullptr,
+                      CredentialSink* sink = nullptr, const byte* firstBlock = nullptr);
     bool writeNdefText(int startBlock, int numBlocks, const String& text);
+    bool writeNdefBytes(int startBlock, int numBlocks, const uint8_t* data, size_t len,
+                        uint8_t* image = nullptr, int* imageBlocks = nullptr);
+    bool writeBlocks(int startBlock, byte* blocks, int count, uint8_t* image, int* imageBlocks);
+    bool writeBlock(int block, byte* data);
+    bool readBlock(int block, byte* buffer);
+    bool readHeaderSector(CardData& card);
+    bool writeCardHeader(const String& cardId, uint16_t credentialLen, uint32_t credentialHash);
+    int dataBlockAddress(int startBlock, int index);
 };
 
 #endif
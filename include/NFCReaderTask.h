@@ -0,0 +1,54 @@
+#ifndef NFCREADERTASK_H
+#define NFCREADERTASK_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include "NFCReader.h"
+#include "ApiClient.h"
+#include "StreamingVerifier.h"
+#include "Models.h"
+#include "config.h"
+
+// Detects and reads cards in its own task and publishes each one as a
+// heap-allocated CardData on a queue, tagged with the door of its reader.
+// The consumer owns that RC522 (for writes/halt) until it calls
+// releaseReader(door); the task does not touch it in between.
+//
+// With several readers on the SPI bus the task is the bus scheduler: one
+// detection poll per free reader per pass, starting after the reader that
+// produced the last card, so a busy door cannot starve the others. Other
+// readers keep being polled while one is handed over; every RC522 register
+// access is its own locked SPI transaction, so the consumer's writes and
+// these polls interleave safely.
+class NFCReaderTask {
+public:
+    NFCReaderTask(NFCReader* const* readers, uint8_t count, ApiClient& api);
+    void begin();
+    void stop();
+    
+    // Next card event or NULL. Caller deletes it, then calls releaseReader(card->door)
+    CardData* receiveCard(uint32_t timeoutMs);
+    bool waitForCard(uint32_t timeoutMs);   // Block until a card is queued
+    void releaseReader(uint8_t door);
+    
+private:
+    NFCReader* const* readers;
+    uint8_t readerCount;
+    ApiClient& api;
+    
+    TaskHandle_t taskHandle;
+    QueueHandle_t cardQueue;
+    volatile bool handedOver[DOOR_COUNT];   // Reader belongs to the consumer
+    uint8_t nextReader;                     // First reader polled in the next pass
+    bool running;
+    
+    StreamingVerifier streamingVerifier;
+    
+    static void readerTaskFunction(void* param);
+    void readerLoop();
+    CardData* readCard(uint8_t door);
+};
+
+#endif
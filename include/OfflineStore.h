@@ -0,0 +1,66 @@
+#ifndef OFFLINESTORE_H
+#define OFFLINESTORE_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include "Models.h"
+#include "OfflineWhitelist.h"
+#include "config.h"
+
+// Offline data (whitelist index + verification keys) persisted in the
+// "offline" flash partition so it survives a reboot during an outage.
+//
+// Two slots of OFFLINE_STORE_SLOT_SIZE, each:
+//   [0..63]   header: magic, version, generation, counts, CRC32s
+//   [64..]    whitelist entries, sorted, OfflineWhitelist::ENTRY_SIZE each
+//   then      key records: kid, alg, expires_at, PEM (length-prefixed)
+// A save goes to the other slot and writes the header last, so a power
+// cut mid-write leaves the previous generation in place. The newest
+// valid slot is memory-mapped; the whitelist is searched in place.
+class OfflineStore {
+public:
+    OfflineStore();
+    ~OfflineStore();
+    
+    // Find the partition and map the newest valid slot (no network needed)
+    bool begin();
+    uint32_t getGeneration() const;     // 0 until a slot has been written
+    
+    // Mapped whitelist, valid until the next save()
+    const void* getEntries() const;
+    size_t getEntryCount() const;
+    
+    // Keys as they came from the backend, current key first
+    int loadKeys(JwtVerificationConfig* out, int maxKeys) const;
+    
+    // Persist if different from what is stored. Remaps on success
+    bool save(const OfflineWhitelist& whitelist, const JwtVerificationConfig* keys, int keyCount);
+    
+private:
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t keyCount;
+        uint32_t generation;
+        uint32_t entryCount;
+        uint32_t keysOffset;    // From slot start
+        uint32_t keysLength;
+        uint32_t bodyCrc;       // Entries + key records
+        uint32_t headerCrc;     // Fields above
+    };
+    
+    const esp_partition_t* partition;
+    spi_flash_mmap_handle_t mapHandle;
+    const uint8_t* mapped;      // Start of the active slot, NULL if none
+    int activeSlot;
+    Header header;
+    
+    bool readHeader(int slot, Header& out);
+    bool mapSlot(int slot, const Header& slotHeader);
+    void unmap();
+    bool writeFromRam(size_t offset, const uint8_t* data, size_t len);
+    static size_t encodeKeys(const JwtVerificationConfig* keys, int keyCount, uint8_t* out, size_t maxLen);
+    static uint32_t headerCrc(const Header& h);
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef OFFLINEWHITELIST_H
+#define OFFLINEWHITELIST_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Offline whitelist index: card_id -> valid_until, kept as a sorted array
+// of fixed-width entries and searched by binary search.
+//
+// RAM: 12 bytes per entry (64-bit card_id hash + epoch valid_until), sized
+// to the received list, at most OFFLINE_WHITELIST_MAX entries. The list is
+// built while the config response streams in, so no JSON copy of it is kept.
+// Once persisted it can be attached to the flash copy (OfflineStore) and
+// the RAM array is released.
+class OfflineWhitelist {
+public:
+    static const size_t ENTRY_SIZE = 12;
+    
+    OfflineWhitelist();
+    ~OfflineWhitelist();
+    
+    // Building: add() in any order, then finalize() (sort + merge duplicates).
+    // False for an empty id, past OFFLINE_WHITELIST_MAX, or out of memory
+    bool add(const char* cardId, size_t len, uint32_t validUntil);
+    void finalize();
+    void clear();
+    
+    // validUntil is 0 when the entry does not expire
+    bool find(const char* cardId, size_t len, uint32_t& validUntil) const;
+    
+    void swap(OfflineWhitelist& other);
+    
+    // Use sorted entries owned elsewhere (memory-mapped flash), read-only
+    void attach(const void* sortedEntries, size_t entryCount);
+    const void* data() const;
+    size_t size() const;
+    size_t memoryBytes() const;
+    
+    // An add() failed to grow the array: entries are missing, do not use the list
+    bool isOutOfMemory() const;
+    
+    // "2025-01-31T23:59:59Z", "2025-02-01T06:59:59+07:00" (or plain epoch digits)
+    // -> epoch seconds, 0 if empty/invalid
+    static uint32_t parseTime(const char* text);
+    
+    // Logs lookup time for growing synthetic lists (ENABLE_WHITELIST_BENCHMARK)
+    static void benchmark();
+    
+private:
+    struct Entry {
+        uint32_t keyHi;     // FNV-1a 64 of card_id, split to stay 4-byte aligned
+        uint32_t keyLo;
+        uint32_t validUntil;
+    };
+    
+    Entry* entries;         // Owned array while building, NULL when attached
+    const Entry* view;      // What find() searches
+    size_t count;
+    size_t capacity;
+    bool outOfMemory;
+    
+    OfflineWhitelist(const OfflineWhitelist&) = delete;
+    OfflineWhitelist& operator=(const OfflineWhitelist&) = delete;
+    
+    static uint64_t keyFor(const char* cardId, size_t len);
+    static bool less(const Entry& a, const Entry& b);
+};
+
+#endif
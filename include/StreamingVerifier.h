@@ -0,0 +1,62 @@
+#ifndef STREAMINGVERIFIER_H
+#define STREAMINGVERIFIER_H
+
+#include <Arduino.h>
+#include <mbedtls/sha256.h>
+#include "CredentialSink.h"
+#include "CredentialCodec.h"
+#include "Models.h"
+
+// Hashes the JWS signing input of a compact ES256 credential while its
+// blocks are still being read, so only the curve check is left once the
+// last block arrives (JWTVerifier::verifyCompactDigest). Header and claims
+// are base64url-encoded into SHA-256(M) as they stream in.
+//
+// ES256 only. EdDSA, the fleet default, is not pipelined: Ed25519 hashes
+// SHA-512(R || A || M) and libsodium has no public verify that takes that
+// hash, while redoing its point arithmetic would cost more than hashing a
+// few hundred bytes. EdDSA and text JWTs verify from the whole credential.
+class StreamingVerifier : public CredentialSink {
+public:
+    StreamingVerifier();
+    ~StreamingVerifier();
+    
+    // Start a new credential
+    void begin();
+    void onCredentialBytes(const uint8_t* data, size_t len) override;
+    
+    // Store the digest in card if the whole credential went through the
+    // hash. False if it was not streamable or did not match what was read
+    bool finish(CardData& card);
+    
+private:
+    enum State {
+        STATE_FIXED,    // Magic, alg, lengths, signature
+        STATE_HEADER,   // Header JSON, hashed once complete
+        STATE_PAYLOAD,  // Claims JSON, encoded into the hash as it arrives
+        STATE_DONE,
+        STATE_SKIP      // Not streamable, the normal verify path takes over
+    };
+    
+    State state;
+    size_t received;
+    
+    uint8_t fixed[CREDENTIAL_COMPACT_FIXED_LEN];
+    uint8_t header[255];
+    uint16_t headerLen;
+    uint16_t payloadLen;
+    uint16_t payloadSeen;
+    
+    // Up to 2 bytes waiting for a full base64 group
+    uint8_t carry[3];
+    uint8_t carryLen;
+    
+    mbedtls_sha256_context sha256;
+    
+    size_t consume(const uint8_t* data, size_t len);
+    void startHash();
+    void hashText(const char* text, size_t len);
+    void hashBase64(const uint8_t* data, size_t len, bool final);
+};
+
+#endif
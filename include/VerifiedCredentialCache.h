@@ -0,0 +1,42 @@
+#ifndef VERIFIEDCREDENTIALCACHE_H
+#define VERIFIEDCREDENTIALCACHE_H
+
+#include <Arduino.h>
+#include "JWTVerifier.h"
+#include "config.h"
+
+#define VERIFIED_CACHE_KEY_LEN 32
+
+// Fixed-size LRU of credentials whose signature already verified offline.
+// Key = SHA-256(credential bytes || card UID || verifying key). A cryptographic hash is
+// required here: a hit skips the signature check, so a key collision
+// would let a forged credential through.
+class VerifiedCredentialCache {
+public:
+    VerifiedCredentialCache();
+    
+    static void makeKey(const uint8_t* credential, size_t len, const String& cardUid,
+                        const JWTPublicKey& publicKey, uint8_t outKey[VERIFIED_CACHE_KEY_LEN]);
+    
+    bool lookup(const uint8_t key[VERIFIED_CACHE_KEY_LEN], JWTPayload& outPayload);
+    void insert(const uint8_t key[VERIFIED_CACHE_KEY_LEN], const JWTPayload& payload);
+    void clear();
+    
+    uint32_t getHits() const;
+    uint32_t getMisses() const;
+    int getCount() const;
+    
+private:
+    struct Entry {
+        uint8_t key[VERIFIED_CACHE_KEY_LEN];
+        JWTPayload payload;
+        uint32_t lastUsed;  // LRU tick, 0 = empty slot
+    };
+    
+    Entry entries[OFFLINE_VERIFY_CACHE_SIZE];
+    uint32_t tick;
+    uint32_t hits;
+    uint32_t misses;
+};
+
+#endif
@@ -14,6 +14,10 @@
 // ============================================
 #define API_BASE_URL "https://boys-participate-pension-classical.trycloudflare.com/api/v1"
 #define API_TIMEOUT_MS 30000
+#define DECISION_CACHE_SIZE 8  // Recent online answers reused for repeat taps
+#define DECISION_CACHE_MAX_TTL_MS 10000  // Cap on the server-provided cache_ttl_sec
+#define PENDING_WRITEBACK_SLOTS 4  // Rotated credentials kept until their card is tapped again
+#define ACCESS_HEDGE_BUDGET_MS 800  // Online check slower than this: open on a local allow (0 = always wait)
 
 // Device Credentials (MOCK)
 #define DEVICE_ID "reader-lobby-01"
@@ -25,9 +29,7 @@
 // ============================================
 // Hardware Pin Configuration
 // ============================================
-// RC522 NFC Reader (SPI)
-#define PIN_NFC_SS   5
-#define PIN_NFC_RST  4
+// RC522 NFC Readers (shared SPI bus, SS/RST/IRQ per door in DOOR_PINS)
 #define PIN_NFC_SCK  18
 #define PIN_NFC_MISO 19
 #define PIN_NFC_MOSI 23
@@ -40,14 +42,36 @@
 #define LCD_ROWS 2
 
 // Relay (2-channel module)
-#define PIN_RELAY_CH1 25
+#define PIN_RELAY_CH1 25  // Lock of the second door in DOOR_PINS
 #define PIN_RELAY_CH2 26  // Used for solenoid/lock
 #define RELAY_ACTIVE_LOW false  // Set true if your relay module is LOW-trigger
 
 // Door Sensor (MC-38, NC type)
-#define PIN_DOOR_SENSOR 27
 #define DOOR_OPEN_LEVEL HIGH  // NC + PULLUP: open = HIGH
 
+// Doors: each has its own RC522 (SS/RST/IRQ on the shared SPI bus), relay
+// channel and door sensor. LCD, buzzer and exit button are shared.
+// The first DOOR_COUNT rows are used, add a row per extra door
+#define DOOR_COUNT 1
+
+struct DoorPins {
+    const char* doorId;
+    int nfcSs;
+    int nfcRst;
+    int nfcIrq;     // Input-only pins are fine, RC522 drives IRQ push-pull
+    int relay;
+    int sensor;
+};
+
+static const DoorPins DOOR_PINS[] = {
+    // door_id      NFC SS  RST  IRQ  relay          sensor
+    { DOOR_ID,      5,      4,   34,  PIN_RELAY_CH2, 27 },
+    { "door_side",  15,     16,  35,  PIN_RELAY_CH1, 17 },
+};
+
+static_assert(DOOR_COUNT >= 1 && DOOR_COUNT <= sizeof(DOOR_PINS) / sizeof(DOOR_PINS[0]),
+              "DOOR_COUNT needs a DOOR_PINS row per door");
+
 // Buzzer
 #define PIN_BUZZER 14
 #define BUZZER_LEDC_CHANNEL 3
@@ -69,7 +93,9 @@
 // ============================================
 #define RELOCK_DELAY_MS 3000        // Auto-relock after door closes
 #define MAX_UNLOCK_DURATION_MS 15000  // Force lock if held too long
-#define CARD_READ_COOLDOWN_MS 1200   // Prevent repeated reads
+#define CARD_READ_COOLDOWN_MS 1200   // Prevent repeated reads (polling mode)
+#define NFC_USE_IRQ true             // Detect cards via RC522 IRQ instead of polling
+#define NFC_IRQ_REARM_MS 50          // REQA period in IRQ mode (worst-case detection latency)
 #define BUTTON_DEBOUNCE_MS 30
 #define BUTTON_COOLDOWN_MS 500
 #define DOOR_DEBOUNCE_MS 20
@@ -80,13 +106,44 @@
 #define HEARTBEAT_INTERVAL_MS 300000  // 5 minutes
 #define CONFIG_REFRESH_INTERVAL_MS 300000  // 5 minutes (same as heartbeat)
 #define MAX_API_FAILURES 3  // Switch to offline mode after 3 consecutive failures
-#define LOG_BATCH_SIZE 20  // Max logs to send in one batch
-#define LOG_QUEUE_SIZE 100  // Max logs to keep in memory
+#define LOG_BATCH_SIZE 20  // Max logs to send in one batch (each batch is acknowledged on its own)
+#define LOG_UPLOAD_WATERMARK 10  // Upload as soon as this many logs are pending
+#define LOG_UPLOAD_IDLE_MS 5000  // ...or when logs are pending and no tap for this long
+#define LOG_UPLOAD_RETRY_MS 30000  // Wait after a failed batch
+#define LOG_UPLOAD_BURST 10  // Max batches per drain, back to back on one connection
+#define LOG_QUEUE_SIZE 100  // Max logs to keep in memory (until written to the journal)
+#define ACCESS_LOG_DIR "/alog"  // LittleFS journal of access logs not yet uploaded
+#define ACCESS_LOG_SEGMENT_RECORDS 256  // 64 bytes each, 16 KB per segment file
+#define ACCESS_LOG_MAX_SEGMENTS 32  // ~8000 decisions kept while offline
+#define CARD_SEND_CREDENTIAL_HASH false  // Online taps send header hash instead of reading the credential (needs backend support)
+
+// ============================================
+// Logging
+// ============================================
+// Compile-time level per module, calls above it are compiled out:
+// 0 none, 1 error, 2 warn, 3 info, 4 debug ([PERF] timings), 5 verbose (block dumps, HTTP bodies)
+#define LOG_LEVEL_NFC 3
+#define LOG_LEVEL_API 3
+#define LOG_LEVEL_JWT 3
+#define LOG_LEVEL_ACCESS 3
+#define LOG_LEVEL_TASKS 3
+#define LOG_RUNTIME_LEVEL 3  // Start-up runtime level, backend config "log_level" can lower/raise it
 
 // ============================================
 // Offline Mode Settings
 // ============================================
-#define OFFLINE_CACHE_FILE "/offline_cache.json"
+#define OFFLINE_STORE_PARTITION "offline"  // Label in partitions.csv
+#define OFFLINE_STORE_SUBTYPE 0x40
+#define OFFLINE_STORE_SLOT_SIZE 0x20000  // Two slots (A/B), 128 KB each
+#define OFFLINE_WHITELIST_MAX 6000  // 12 bytes each, 72 KB heap when full
+#define OFFLINE_VERIFY_CACHE_SIZE 16  // Verified credentials kept to skip repeat signature checks
+#define JWT_KEYRING_SIZE 4  // Current key + retired keys still inside their overlap window
+#define JWT_KID_MAX_LEN 32
+#define CLOCK_VALID_AFTER 1704067200UL  // 2024-01-01, earlier time() means NTP has not synced yet
+#define JWT_ED25519_HW_SHA true  // Ed25519 verify via libsodium (hardware SHA-512), false = Crypto library
+#define ENABLE_CRYPTO_BENCHMARK false  // Time EdDSA vs ES256 verify at boot ([BENCH] log lines)
+#define CRYPTO_BENCHMARK_ITERATIONS 20
+#define ENABLE_WHITELIST_BENCHMARK false  // Time whitelist lookups for 100/1000/5000 entries at boot
 #define DEVICE_TOKEN_FILE "/device_token.txt"
 
 // ============================================
@@ -98,6 +155,16 @@
 #define COMMAND_POLL_TASK_STACK_SIZE 8192  // 8KB stack for FreeRTOS task
 #define COMMAND_POLL_TASK_PRIORITY 1  // Same priority as loop()
 
+// NFC reader task (card detection/reading off the loop)
+#define NFC_TASK_STACK_SIZE 6144
+#define NFC_TASK_PRIORITY 2  // Above loop() so a tap preempts it
+#define NFC_TASK_IDLE_MS 10  // Sleep between detection polls
+
+// Online access check task (hedged decisions)
+#define ACCESS_CHECK_TASK_STACK_SIZE 8192
+#define ACCESS_CHECK_TASK_PRIORITY 1
+#define ACCESS_CHECK_QUEUE_DEPTH 4  // Checks waiting per door, taps keep going while the server is slow
+
 // Door Monitoring & Status Reporting
 #define ENABLE_STATUS_REPORTING true
 #define DOOR_MONITORING_CHECK_INTERVAL_MS 100  // Check door state every 0.1s
@@ -32,8 +32,13 @@
 #include "AccessController.h"
 #include "CommandPollingTask.h"
 #include "DoorMonitoringTask.h"
+#include "NFCReaderTask.h"
+#include "AccessCheckTask.h"
 #include "ConfigManager.h"
 #include "ConfigPortal.h"
+#if ENABLE_CRYPTO_BENCHMARK
+#include "CryptoBenchmark.h"
+#endif
 
 // Quản lý cấu hình
 ConfigManager configManager;
@@ -42,31 +47,51 @@ DeviceConfiguration deviceConfig;
 // Khởi tạo các module (sẽ cài đặt thông số sau khi load config)
 WiFiManager wifiManager(WIFI_SSID, WIFI_PASSWORD);
 ApiClient apiClient(API_BASE_URL);  // Link API sẽ cập nhật đè lại sau
-NFCReader nfcReader(PIN_NFC_SS, PIN_NFC_RST);
 LCDDisplay lcdDisplay(LCD_I2C_ADDR, LCD_COLS, LCD_ROWS);
-RelayControl relayControl(PIN_RELAY_CH2, RELAY_ACTIVE_LOW);
 BuzzerControl buzzer(PIN_BUZZER, BUZZER_LEDC_CHANNEL);
-DoorSensor doorSensor(PIN_DOOR_SENSOR, DOOR_OPEN_LEVEL);
 ButtonControl button(PIN_BUTTON, BUTTON_ACTIVE_LOW);
 
+#if !ENABLE_STATUS_REPORTING
+#error "STATUS_REPORTING must be enabled for proper door monitoring"
+#endif
+
+// Mỗi cửa: đầu đọc riêng trên cùng bus SPI, relay, cảm biến và các tác vụ riêng,
+// tạo theo bảng DOOR_PINS trong createDoors()
+DoorChannel doors[DOOR_COUNT];
+NFCReader* nfcReaders[DOOR_COUNT];
+
+// Tác vụ NFC lần lượt quét các đầu đọc
+NFCReaderTask nfcReaderTask(nfcReaders, DOOR_COUNT, apiClient);
+
 // Trang web cấu hình
 ConfigPortal configPortal(configManager);
 
-#if ENABLE_STATUS_REPORTING
-DoorMonitoringTask monitoringTask(apiClient, relayControl, doorSensor, buzzer, lcdDisplay, DOOR_ID);
-#endif
-
 // Bộ điều khiển ra vào
-#if ENABLE_STATUS_REPORTING
-AccessController accessController(nfcReader, apiClient, relayControl, lcdDisplay, buzzer, doorSensor, monitoringTask);
-#else
-#error "STATUS_REPORTING must be enabled for proper door monitoring"
-#endif
+AccessController accessController(apiClient, lcdDisplay, buzzer, nfcReaderTask, doors, DOOR_COUNT);
 
 #if ENABLE_COMMAND_POLLING
-CommandPollingTask pollingTask(apiClient, accessController, lcdDisplay, relayControl);
+CommandPollingTask* pollingTasks[DOOR_COUNT];
 #endif
 
+void createDoors() {
+    for (int i = 0; i < DOOR_COUNT; i++) {
+        const DoorPins& pins = DOOR_PINS[i];
+        DoorChannel& door = doors[i];
+        
+        door.doorId = pins.doorId;
+        door.nfc = new NFCReader(pins.nfcSs, pins.nfcRst, NFC_USE_IRQ ? pins.nfcIrq : -1);
+        door.relay = new RelayControl(pins.relay, RELAY_ACTIVE_LOW);
+        door.sensor = new DoorSensor(pins.sensor, DOOR_OPEN_LEVEL);
+        door.monitor = new DoorMonitoringTask(apiClient, *door.relay, *door.sensor, buzzer, lcdDisplay, pins.doorId);
+        door.checkTask = new AccessCheckTask(apiClient);
+        nfcReaders[i] = door.nfc;
+        
+        #if ENABLE_COMMAND_POLLING
+        pollingTasks[i] = new CommandPollingTask(apiClient, accessController, lcdDisplay, door, i);
+        #endif
+    }
+}
+
 bool inConfigMode = false;
 String deviceToken;
 uint32_t lastHeartbeat = 0;
@@ -83,25 +108,36 @@ void setup() {
     bootTime = millis();
     
     Serial.println("[INIT] Dang khoi tao phan cung...");
+    createDoors();
     
     lcdDisplay.begin(PIN_LCD_SDA, PIN_LCD_SCL);
     lcdDisplay.show("Dang khoi dong", "Vui long cho...");
     
-    SPI.begin(PIN_NFC_SCK, PIN_NFC_MISO, PIN_NFC_MOSI, PIN_NFC_SS);
-    nfcReader.begin();
+    SPI.begin(PIN_NFC_SCK, PIN_NFC_MISO, PIN_NFC_MOSI, DOOR_PINS[0].nfcSs);
+    
+    // Các đầu đọc dùng chung bus: nhả hết SS trước khi khởi tạo từng cái
+    for (int i = 0; i < DOOR_COUNT; i++) {
+        doors[i].nfc->deselect();
+    }
+    for (int i = 0; i < DOOR_COUNT; i++) {
+        doors[i].nfc->begin();
+        doors[i].relay->begin();
+        doors[i].sensor->begin();
+    }
     
-    relayControl.begin();
     buzzer.begin();
-    doorSensor.begin();
     button.begin();
     
     Serial.println("[INIT] Phan cung OK");
     
+    // Whitelist + khóa đã lưu: quyết định offline được ngay cả khi chưa có mạng
+    accessController.begin();
+    
     Serial.println("[INIT] Dang doc cau hinh...");
     configManager.begin();
     
     bool configLoaded = configManager.load(deviceConfig);
-    
+   
    // Nếu là lần đầu chạy (chưa có config) thì vào chế độ cài đặt
     if (!configLoaded || !deviceConfig.configured) {
         Serial.println("[INIT] Phat hien chay lan dau - Vao che do cau hinh");
@@ -191,20 +227,39 @@ void setup() {
       Serial.println("[INIT] Khong tai duoc cau hinh");
     }
     
+    #if ENABLE_CRYPTO_BENCHMARK
+    CryptoBenchmark::run(CRYPTO_BENCHMARK_ITERATIONS);
+    #endif
+    #if ENABLE_WHITELIST_BENCHMARK
+    OfflineWhitelist::benchmark();
+    #endif
+    
     lcdDisplay.show("San sang", "Moi quet the");
     buzzer.accessGranted();  // Kêu cái bíp báo hiệu xong
     Serial.println("[INIT] He thong san sang!");
     
     #if ENABLE_COMMAND_POLLING
     Serial.println("[INIT] Bat tac vu nhan lenh...");
-    pollingTask.begin();
+    for (int i = 0; i < DOOR_COUNT; i++) {
+        pollingTasks[i]->begin();
+    }
     #endif
     
     #if ENABLE_STATUS_REPORTING
     Serial.println("[INIT] Bat tac vu theo doi cua...");
-    monitoringTask.begin();
+    for (int i = 0; i < DOOR_COUNT; i++) {
+        doors[i].monitor->begin();
+    }
     #endif
     
+    Serial.println("[INIT] Bat tac vu kiem tra quyen...");
+    for (int i = 0; i < DOOR_COUNT; i++) {
+        doors[i].checkTask->begin();
+    }
+    
+    Serial.println("[INIT] Bat tac vu doc the NFC...");
+    nfcReaderTask.begin();
+
 }
 
 
@@ -344,11 +399,8 @@ void loop() {
         buttonWasPressed = false;
     }
     
-    if (nfcReader.isCardPresent()) {
-        accessController.handleCardTap();
-    }
-    
     accessController.update();
+    buzzer.update();
     
     if (now - lastHeartbeat >= HEARTBEAT_INTERVAL_MS) {
         lastHeartbeat = now;
@@ -358,16 +410,17 @@ void loop() {
         status.rssi = wifiManager.getRSSI(); // Sóng wifi khỏe không
         status.fw_version = FIRMWARE_VERSION;
         status.last_access_ts = ""; 
+        accessController.getVerifyCacheStats(status.verify_cache_hits, status.verify_cache_misses);
+        status.loop_stack_free = uxTaskGetStackHighWaterMark(NULL);  // Byte trên ESP32
+        status.logs_dropped = accessController.getDroppedLogCount();
+        status.offline_store_gen = accessController.getOfflineStoreGeneration();
         
         if (apiClient.sendHeartbeat(status)) {
             Serial.println("[HEARTBEAT] Gui ok");
         } else {
             Serial.println("[HEARTBEAT] Gui that bai");
         }
-        
-        if (accessController.getQueuedLogCount() > 0) {
-            accessController.uploadQueuedLogs();
-        }
+        // Nhật ký được gửi trong accessController.update() (theo ngưỡng / lúc rảnh)
     }
     
     if (now - lastConfigRefresh >= CONFIG_REFRESH_INTERVAL_MS) {
@@ -382,5 +435,6 @@ void loop() {
         }
     }
     
-    delay(10);
+    // Sleep 10ms, or less if the NFC task has a card ready
+    nfcReaderTask.waitForCard(10);
 }
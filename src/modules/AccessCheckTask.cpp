@@ -0,0 +1,172 @@
+#include "AccessCheckTask.h"
+#include "CredentialCodec.h"
+#include <new>
+
+#define LOG_MODULE_LEVEL LOG_LEVEL_TASKS
+#include "Log.h"
+
+AccessCheckTask::AccessCheckTask(ApiClient& api)
+    : api(api), taskHandle(NULL), jobQueue(NULL), resultQueue(NULL),
+      running(false), nextTicket(0), finishedCount(0) {
+}
+
+void AccessCheckTask::begin() {
+    if (taskHandle != NULL) {
+        LOG_W("CHECK_TASK", "Task already running");
+        return;
+    }
+    
+    // Results never outnumber queued jobs plus the one running, the task
+    // does not block handing them over
+    jobQueue = xQueueCreate(ACCESS_CHECK_QUEUE_DEPTH, sizeof(AccessCheckJob*));
+    resultQueue = xQueueCreate(ACCESS_CHECK_QUEUE_DEPTH + 1, sizeof(AccessCheckJob*));
+    if (jobQueue == NULL || resultQueue == NULL) {
+        LOG_E("CHECK_TASK", "❌ Failed to create queue!");
+        return;
+    }
+    
+    running = true;
+    
+    // Core 0 with the WiFi stack, loop() keeps core 1 for local verification
+    BaseType_t result = xTaskCreatePinnedToCore(
+        checkTaskFunction,
+        "AccessCheck",
+        ACCESS_CHECK_TASK_STACK_SIZE,
+        this,
+        ACCESS_CHECK_TASK_PRIORITY,
+        &taskHandle,
+        0  // Core 0
+    );
+    
+    if (result == pdPASS) {
+        LOG_I("CHECK_TASK", "✅ Task created and started on core 0");
+    } else {
+        LOG_E("CHECK_TASK", "❌ Failed to create task!");
+        running = false;
+    }
+}
+
+void AccessCheckTask::stop() {
+    if (taskHandle == NULL) {
+        return;
+    }
+    
+    running = false;
+    vTaskDelay(pdMS_TO_TICKS(200));
+    vTaskDelete(taskHandle);
+    taskHandle = NULL;
+    
+    LOG_I("CHECK_TASK", "Task stopped");
+}
+
+uint32_t AccessCheckTask::submit(const AccessCheckRequest& request) {
+    if (taskHandle == NULL) {
+        return 0;
+    }
+    
+    AccessCheckJob* job = new (std::nothrow) AccessCheckJob();
+    if (job == NULL) {
+        return 0;
+    }
+    
+    job->request = request;
+    job->success = false;
+    job->startedMs = millis();
+    
+    // credential_bin points into the card buffer, which the caller frees
+    // while the request may still be running
+    CompactCredential compact;
+    if (job->request.credential_raw.length() == 0 && job->request.credential_bin_len > 0 &&
+        CredentialCodec::parse(job->request.credential_bin, job->request.credential_bin_len, compact)) {
+        job->request.credential_raw = CredentialCodec::toJwt(compact);
+    }
+    job->request.credential_bin = NULL;
+    job->request.credential_bin_len = 0;
+    
+    if (++nextTicket == 0) nextTicket = 1;
+    job->ticket = nextTicket;
+    
+    // The task may finish and hand the job on before xQueueSend returns
+    uint32_t ticket = job->ticket;
+    if (xQueueSend(jobQueue, &job, 0) != pdTRUE) {
+        LOG_W("CHECK_TASK", "Queue full, check not sent");
+        delete job;
+        return 0;
+    }
+    return ticket;
+}
+
+AccessCheckJob* AccessCheckTask::waitResult(uint32_t ticket, uint32_t timeoutMs) {
+    uint32_t startMs = millis();
+    
+    while (true) {
+        for (int i = 0; i < finishedCount; i++) {
+            if (finished[i]->ticket == ticket) {
+                return removeFinished(i);
+            }
+        }
+        
+        uint32_t elapsed = millis() - startMs;
+        uint32_t left = elapsed < timeoutMs ? timeoutMs - elapsed : 0;
+        
+        AccessCheckJob* job = NULL;
+        if (xQueueReceive(resultQueue, &job, pdMS_TO_TICKS(left)) != pdTRUE) {
+            return NULL;
+        }
+        
+        // Answer to another tap, kept for takeLate()
+        keepFinished(job);
+    }
+}
+
+AccessCheckJob* AccessCheckTask::takeLate(uint32_t keepTicket) {
+    AccessCheckJob* job = NULL;
+    while (resultQueue != NULL && xQueueReceive(resultQueue, &job, 0) == pdTRUE) {
+        keepFinished(job);
+    }
+    
+    for (int i = 0; i < finishedCount; i++) {
+        if (finished[i]->ticket != keepTicket) {
+            return removeFinished(i);
+        }
+    }
+    return NULL;
+}
+
+void AccessCheckTask::keepFinished(AccessCheckJob* job) {
+    if (finishedCount == ACCESS_CHECK_QUEUE_DEPTH + 1) {
+        // Nobody collected the oldest one, its tap is long over
+        LOG_W("CHECK_TASK", "Dropping unclaimed answer #%lu", (unsigned long)finished[0]->ticket);
+        delete removeFinished(0);
+    }
+    finished[finishedCount++] = job;
+}
+
+AccessCheckJob* AccessCheckTask::removeFinished(int index) {
+    AccessCheckJob* job = finished[index];
+    memmove(&finished[index], &finished[index + 1], (finishedCount - index - 1) * sizeof(AccessCheckJob*));
+    finishedCount--;
+    return job;
+}
+
+void AccessCheckTask::checkTaskFunction(void* param) {
+    AccessCheckTask* instance = static_cast<AccessCheckTask*>(param);
+    LOG_I("CHECK_TASK", "Access check task running...");
+    instance->checkLoop();
+    vTaskDelete(NULL);
+}
+
+void AccessCheckTask::checkLoop() {
+    while (running) {
+        AccessCheckJob* job = NULL;
+        if (xQueueReceive(jobQueue, &job, pdMS_TO_TICKS(100)) != pdTRUE) {
+            continue;
+        }
+        
+        job->success = api.checkAccess(job->request, job->response, &connection);
+        LOG_D("PERF", "Access check #%lu: %lums", (unsigned long)job->ticket,
+              (unsigned long)(millis() - job->startedMs));
+        
+        xQueueSend(resultQueue, &job, portMAX_DELAY);
+    }
+}
@@ -1,392 +1,857 @@
 #include "AccessController.h"
 #include "JWTVerifier.h"
+#include "CredentialCodec.h"
 #include "DoorMonitoringTask.h"
+#include "NFCReaderTask.h"
+#include "AccessCheckTask.h"
 
-AccessController::AccessController(NFCReader& nfc, ApiClient& api, RelayControl& relay,
-                                   LCDDisplay& lcd, BuzzerControl& buzzer, DoorSensor& door,
-                                   DoorMonitoringTask& doorMonitor)
-    : nfc(nfc), api(api), relay(relay), lcd(lcd), buzzer(buzzer), door(door), doorMonitor(doorMonitor),
-      whitelistCount(0), logQueueCount(0) {
+#define LOG_MODULE_LEVEL LOG_LEVEL_ACCESS
+#include "Log.h"
+
+// Unknown card: the ID gets cleared for re-enrollment, nothing else is written
+static bool isCardRecovery(const AccessCheckResponse& response) {
+    return response.reason == "CARD_NOT_FOUND" || response.reason == "CARD_DELETED";
 }
 
-void AccessController::update() {
+AccessController::AccessController(ApiClient& api, LCDDisplay& lcd, BuzzerControl& buzzer,
+                                   NFCReaderTask& nfcTask, DoorChannel* doors, uint8_t doorCount)
+    : api(api), lcd(lcd), buzzer(buzzer), nfcTask(nfcTask), doors(doors), doorCount(doorCount),
+      feedbackActive(false), feedbackUntilMs(0),
+      lastLogMs(0), lastUploadFailMs(0), uploadFailed(false) {
+    for (uint8_t i = 0; i < DOOR_COUNT; i++) {
+        taps[i].door = i;
+        taps[i].state = TAP_IDLE;
+        taps[i].card = NULL;
+        taps[i].ticket = 0;
+        taps[i].startMs = 0;
+        taps[i].localAllow = false;
+        memset(hedgedTickets[i], 0, sizeof(hedgedTickets[i]));
+        hedgedNext[i] = 0;
+    }
 }
 
-void AccessController::handleCardTap() {
-    uint32_t tapStartMs = millis();
+bool AccessController::begin() {
+    // Door channels are filled in by then, not at construction
+    for (uint8_t i = 0; i < doorCount; i++) {
+        logQueue.setDoorId(i, doors[i].doorId);
+    }
     
-    CardData card = nfc.readCard();
-    uint32_t readMs = millis() - tapStartMs;
-
-    Serial.print("[PERF] Card UID: ");
-    Serial.print(card.card_uid);
-    Serial.print(" | NFC read: ");
-    Serial.print(readMs);
-    Serial.println("ms");
+    // Logs not uploaded before the last reset are sent when back online
+    journal.begin(logQueue);
+    
+    // Offline decisions must work right after a reboot, even if the backend
+    // is unreachable and no config response ever arrives
+    if (!store.begin()) {
+        return false;
+    }
+    
+    whitelist.attach(store.getEntries(), store.getEntryCount());
+    
+    JwtVerificationConfig keys[JWT_KEYRING_SIZE];
+    int keyCount = store.loadKeys(keys, JWT_KEYRING_SIZE);
+    loadKeyRing(keys, keyCount);
+    
+    LOG_I("CONFIG", "Stored whitelist: %u entries, key ring: %d key(s)",
+          (unsigned)whitelist.size(), keyRing.getCount());
+    return true;
+}
 
-    lcd.show("Card detected", card.card_uid.substring(0, 15));
+void AccessController::update() {
+    bool tapInProgress = false;
+    for (uint8_t i = 0; i < doorCount; i++) {
+        Tap& tap = taps[i];
+        if (tap.state == TAP_DECIDING) {
+            // Reader stays held until the server answers or the budget runs out
+            pollDecision(tap);
+        } else if (tap.state == TAP_WRITEBACK) {
+            // Decision already acted on, this pass only writes the card
+            writeBack(tap);
+        }
+        tapInProgress |= tap.card != NULL;
+    }
+    
+    if (feedbackActive && (int32_t)(millis() - feedbackUntilMs) >= 0) {
+        lcd.show(feedbackNext1, feedbackNext2);
+        feedbackActive = false;
+    }
+    
+    // Cards are detected/read by the NFC task, decisions are made here
+    CardData* card = nfcTask.receiveCard(0);
+    if (card == NULL) {
+        if (!tapInProgress) {
+            // Idle: move logged decisions to flash, outside the tap
+            reconcileLateChecks();
+            flushLogs();
+            scheduleLogUpload();
+        }
+        return;
+    }
+    
+    // A new tap replaces the pending message
+    feedbackActive = false;
+    handleCardTap(card);
+}
 
+void AccessController::handleCardTap(CardData* card) {
+    Tap& tap = taps[card->door < doorCount ? card->door : 0];
+    tap.card = card;
+    tap.state = TAP_IDLE;
+    tap.startMs = millis();
+    
+    LOG_D("PERF", "Card UID: %s | door %u | queued: %lums", card->card_uid.c_str(), tap.door,
+          (unsigned long)(tap.startMs - card->detected_ms));
+    
+    lcd.show("Card detected", card->card_uid.substring(0, 15));
+    
+    // Header we cannot read or parse -> deny, enrolling would overwrite the card
+    if (card->header_unreadable) {
+        LOG_W("ACCESS", "Card header unreadable, denied");
+        buzzer.accessDenied();
+        queueLog(ACCESS_LOG_DENY, "CARD_UNREADABLE", "", card->card_uid, tap.door);
+        showFeedback("Card unreadable", "Contact admin", 1500, "Ready", "Tap a card");
+        finishTap(tap);
+        return;
+    }
+    
     // Blank card -> Enroll
-    if (!card.has_card_id) {
-        handleBlankCard(card.card_uid);
+    if (!card->has_card_id) {
+        handleBlankCard(tap);
+        finishTap(tap);
         return;
     }
     
-    handleCardWithId(card);
+    handleCardWithId(tap);
 }
 
-void AccessController::handleBlankCard(const String& card_uid) {
-    Serial.println("[NFC] Blank card detected, enrolling...");
+void AccessController::handleBlankCard(Tap& tap) {
+    NFCReader& nfc = *doors[tap.door].nfc;
+    
+    LOG_I("NFC", "Blank card detected, enrolling...");
     lcd.show("Blank card", "Keep on reader!");
     
     CardCreateRequest request;
     request.device_id = DEVICE_ID;
-    request.card_uid = card_uid;
+    request.card_uid = tap.card->card_uid;
     
     CardCreateResponse response;
     bool success = false;
     
     if (api.createCard(request, response)) {
-        Serial.print("[API] Card enrolled, ID: ");
-        Serial.println(response.card_id);
+        LOG_I("API", "Card enrolled, ID: %s", response.card_id.c_str());
         
         // Write card_id
         if (nfc.writeCardId(response.card_id)) {
             // Clear old credential (requires reconnect)
             if (nfc.reconnect()) {
                 if (nfc.clearCredential()) {
-                   Serial.println("[ENROLL] Old credential wiped");
+                   LOG_D("ENROLL", "Old credential wiped");
                 }
             } else {
-                Serial.println("[ENROLL] Failed to reconnect for credential wipe (minor issue)");
+                LOG_W("ENROLL", "Failed to reconnect for credential wipe (minor issue)");
             }
             
-            lcd.show("Enrolled!", response.card_id);
             buzzer.accessGranted();
-            delay(2000);
-            lcd.show("Ready", "Tap again");
+            showFeedback("Enrolled!", response.card_id, 2000, "Ready", "Tap again");
             success = true;
         } else {
-            lcd.show("Write failed", "Card works anyway");
             buzzer.accessGranted();  // Still success, backend has it
-            Serial.println("[NFC] Failed to write card_id (backend enrolled)");
-            delay(2000);
-            lcd.show("Ready", "Tap again");
+            LOG_W("NFC", "Failed to write card_id (backend enrolled)");
+            showFeedback("Write failed", "Card works anyway", 2000, "Ready", "Tap again");
             success = true;
         }
         
         // Enrollment log handled by backend
     } else {
-        lcd.show("Enroll failed", "Try again");
         buzzer.accessDenied();
-        Serial.println("[API] Failed to enroll card");
-        delay(1500);
-        lcd.show("Ready", "Tap a card");
+        LOG_E("API", "Failed to enroll card");
+        showFeedback("Enroll failed", "Try again", 1500, "Ready", "Tap a card");
     }
     
-    nfc.haltCard();
-    Serial.println(success ? "[ENROLL] Success - reader ready" : "[ENROLL] Failed - reader ready");
+    LOG_I("ENROLL", "%s - reader ready", success ? "Success" : "Failed");
 }
 
-void AccessController::handleCardWithId(const CardData& card) {
-    uint32_t stepStartMs = millis();
+void AccessController::handleCardWithId(Tap& tap) {
+    CardData& card = *tap.card;
+    DoorChannel& door = doors[tap.door];
     
-    AccessCheckRequest request;
+    AccessCheckRequest& request = tap.request;
     request.device_id = DEVICE_ID;
-    request.door_id = DOOR_ID;
+    request.door_id = door.doorId;
     request.card_id = card.card_id;
     request.card_uid = card.card_uid;
     request.credential_raw = card.has_credential ? card.credential.raw : "";
+    request.credential_bin = card.credential_bin;
+    request.credential_bin_len = card.has_credential ? card.credential_bin_len : 0;
+    request.credential_hash_only = !card.has_credential && card.has_header && card.credential_len > 0;
+    request.credential_hash = card.credential_hash;
+    request.credential_len = card.credential_len;
     request.timestamp = api.getTimestamp();
     
+    // Repeat tap within the TTL of the server's last answer
+    if (!api.isOffline() && applyCachedDecision(tap)) {
+        LOG_D("PERF", "Total (cached): %lums", (unsigned long)(millis() - tap.startMs));
+        completeTap(tap, NULL);
+        return;
+    }
+    
+    if (api.isOffline()) {
+        decideOffline(tap);
+        LOG_D("PERF", "Total (offline): %lums", (unsigned long)(millis() - tap.startMs));
+        completeTap(tap, NULL);
+        return;
+    }
+    
+    // Answers to earlier taps go to the log first
+    reconcileLateChecks();
+    
+    tap.ticket = door.checkTask->submit(request);
+    
+    // Local verification while the request is in flight (hedged decision)
+    tap.localAllow = false;
+    if (ACCESS_HEDGE_BUDGET_MS > 0) {
+        if (!card.has_credential) {
+            door.nfc->readCredential(card);
+        }
+        tap.localAllow = checkOfflineWhitelist(card.card_id, card);
+    }
+    
+    // Answer arrives through update() -> pollDecision()
+    tap.state = TAP_DECIDING;
+    pollDecision(tap);
+}
+
+void AccessController::pollDecision(Tap& tap) {
+    AccessCheckTask& checkTask = *doors[tap.door].checkTask;
+    if (tap.ticket == 0) {
+        // Queue was full when the card was read, the server still gets asked
+        tap.ticket = checkTask.submit(tap.request);
+    }
+    AccessCheckJob* job = tap.ticket != 0 ? checkTask.waitResult(tap.ticket, 0) : NULL;
+    uint32_t elapsed = millis() - tap.startMs;
+    
+    if (job == NULL) {
+        if (tap.localAllow && elapsed >= ACCESS_HEDGE_BUDGET_MS) {
+            // Server too slow: open on the local decision, its answer is
+            // logged when it arrives
+            LOG_I("HEDGE", "No answer in %lums, local decision: allow", (unsigned long)elapsed);
+            tap.state = TAP_IDLE;
+            lcd.show("Access granted", "Welcome");
+            grantTapAccess(tap, "LOCAL_HEDGE");
+            queueLog(ACCESS_LOG_ALLOW, "LOCAL_HEDGE", tap.card->card_id, tap.card->card_uid, tap.door);
+            rememberHedge(tap.door, tap.ticket);
+            LOG_D("PERF", "Total (hedged): %lums", (unsigned long)(millis() - tap.startMs));
+            completeTap(tap, NULL);
+            return;
+        }
+        
+        // Local check says no (or cannot tell): the server decides, as without hedging
+        if (elapsed < API_TIMEOUT_MS + ACCESS_HEDGE_BUDGET_MS) {
+            return;
+        }
+    }
+    
+    tap.state = TAP_IDLE;
+    
     AccessCheckResponse response;
+    bool apiSuccess = false;
+    if (job != NULL) {
+        apiSuccess = job->success;
+        response = job->response;
+        delete job;
+    }
     
-    uint32_t apiStartMs = millis();
-    bool apiSuccess = api.checkAccess(request, response);
-    uint32_t apiDurationMs = millis() - apiStartMs;
+    LOG_D("PERF", "API call: %lums", (unsigned long)elapsed);
     
-    Serial.print("[PERF] API call: ");
-    Serial.print(apiDurationMs);
-    Serial.println("ms");
+    applyDecision(tap, apiSuccess, response);
+    
+    LOG_D("PERF", "Total access check: %lums", (unsigned long)(millis() - tap.startMs));
+    bool rotated = apiSuccess && response.has_credential && !isCardRecovery(response);
+    completeTap(tap, rotated ? &response.credential : NULL);
+}
+
+void AccessController::applyDecision(Tap& tap, bool apiSuccess, AccessCheckResponse& response) {
+    CardData& card = *tap.card;
     
     if (!apiSuccess && !api.isOffline()) {
         // Network error, not yet offline
         lcd.show("Server error", "Try again");
         buzzer.accessDenied();
-        queueLog(createLog("DENY", "SERVER_ERROR", card.card_id, card.card_uid));
-        // CRITICAL: Halt card before returning
-        nfc.haltCard();
-        
-        uint32_t totalMs = millis() - stepStartMs;
-        Serial.print("[PERF] Total (error): ");
-        Serial.print(totalMs);
-        Serial.println("ms");
+        queueLog(ACCESS_LOG_DENY, "SERVER_ERROR", card.card_id, card.card_uid, tap.door);
         return;
     }
     
     if (!apiSuccess && api.isOffline()) {
-        // Offline mode - verify JWT and check whitelist
-        Serial.println("[OFFLINE] API unavailable - verifying JWT");
-        
-        if (checkOfflineWhitelist(card.card_id, card)) {
-            // Card is authorized via JWT verification
-            Serial.print("[OFFLINE] Access granted for: ");
-            Serial.println(card.card_id);
-            
-            lcd.show("OFFLINE MODE", "Access granted");
-            grantAccess("OFFLINE_WHITELIST");
-            queueLog(createLog("ALLOW", "OFFLINE_WHITELIST", card.card_id, card.card_uid));
-        } else {
-            // JWT verification failed or not in whitelist
-            Serial.println("[OFFLINE] Access denied");
-            lcd.show("OFFLINE", "Access denied");
-            buzzer.accessDenied();
-            queueLog(createLog("DENY", "OFFLINE_NOT_WHITELISTED", card.card_id, card.card_uid));
-        }
-        
-        // CRITICAL: Halt card before returning
-        nfc.haltCard();
-        
-        uint32_t totalMs = millis() - stepStartMs;
-        Serial.print("[PERF] Total (offline): ");
-        Serial.print(totalMs);
-        Serial.println("ms");
+        decideOffline(tap);
         return;
     }
     
-    // Update credential (key rotation, enrollment, etc.)
-    if (response.has_credential) {
-        bool needsUpdate = false;
-        
-        // Check if credential is different
-        if (!card.has_credential) {
-            needsUpdate = true;  // No credential on card
-            Serial.println("[PERF] No credential on card, updating");
-        } else if (card.credential.raw != response.credential.raw) {
-            needsUpdate = true;  // Credential changed
-            Serial.println("[PERF] Credential changed, updating");
-        } else {
-            Serial.println("[PERF] Credential unchanged, skipping write");
-        }
-        
-        if (needsUpdate) {
-            lcd.show("Updating card", "Keep on reader!");
-            delay(50);  // Reduced from 100ms
-            
-            uint32_t writeStartMs = millis();
-            // Try to write credential
-            if (nfc.writeCredential(response.credential)) {
-                uint32_t writeDurationMs = millis() - writeStartMs;
-                Serial.print("[PERF] Credential write: ");
-                Serial.print(writeDurationMs);
-                Serial.println("ms");
-                
-                lcd.show("Card updated!", "Welcome");
-                delay(150);  // Reduced from 800ms
-            } else {
-                Serial.println("[NFC] Failed to write credential");
-                lcd.show("Update failed", "Access granted"); // Message might be "Update failed" but access logic follows
-                delay(150);  // Reduced from 800ms
-            }
-        }
+    // Card recovery must reach the card, don't reuse it. A credential update
+    // can be cached: it waits in pendingWrites for the next tap
+    if (!isCardRecovery(response)) {
+        uint8_t key[DECISION_CACHE_KEY_LEN];
+        DecisionCache::makeKey(tap.request, key);
+        decisionCache.insert(key, response);
     }
-
-    // Check access result
+    
+    // Act on the decision first, a new credential is written afterwards (completeTap)
     if (response.result == "ALLOW") {
-        Serial.println("[ACCESS] ALLOWED");
+        LOG_I("ACCESS", "ALLOWED");
         
         if (response.has_user) {
-            Serial.print("[ACCESS] User: ");
-            Serial.println(response.user.name);
+            LOG_I("ACCESS", "User: %s", response.user.name.c_str());
             lcd.show("Welcome", response.user.name);
         } else {
             lcd.show("Access granted", "Welcome");
         }
         
-        grantAccess(response.reason);
-        queueLog(createLog("ALLOW", response.reason, card.card_id, card.card_uid));
-        
+        grantTapAccess(tap, response.reason);
+        queueLog(ACCESS_LOG_ALLOW, response.reason, card.card_id, card.card_uid, tap.door);
+    
     } else {
-        Serial.print("[ACCESS] DENIED - ");
-        Serial.println(response.reason);
+        LOG_I("ACCESS", "DENIED - %s", response.reason.c_str());
         
         // Card deleted: Clear ID to allow re-enrollment
-        if (response.reason == "CARD_NOT_FOUND" || response.reason == "CARD_DELETED") {
+        if (isCardRecovery(response)) {
+            NFCReader& nfc = *doors[tap.door].nfc;
             
-            Serial.println("[RECOVERY] Card not found, clearing...");
+            LOG_I("RECOVERY", "Card not found, clearing...");
+            forgetWriteBack(card.card_id);
             lcd.show("Card deleted", "Clearing...");
             
             if (nfc.reconnect()) {
                 if (nfc.clearCardId()) {
                     lcd.show("Card cleared", "Tap to re-enroll");
                     buzzer.accessDenied();
-                    delay(2000);
-                    queueLog(createLog("DENY", "CARD_CLEARED_FOR_REENROLL", card.card_id, card.card_uid));
+                    queueLog(ACCESS_LOG_DENY, "CARD_CLEARED_FOR_REENROLL", card.card_id, card.card_uid, tap.door);
                 } else {
                     lcd.show("Clear failed", "Contact admin");
                     buzzer.accessDenied();
-                    delay(2000);
-                    queueLog(createLog("DENY", response.reason, card.card_id, card.card_uid));
+                    queueLog(ACCESS_LOG_DENY, response.reason, card.card_id, card.card_uid, tap.door);
                 }
             } else {
-                Serial.println("[RECOVERY] Failed to reconnect to card");
+                LOG_W("RECOVERY", "Failed to reconnect to card");
                 lcd.show("Clear failed", "Card removed?");
                 buzzer.accessDenied();
-                delay(2000);
             }
         } else {
             // Normal deny with reason
             lcd.show("Access denied", response.reason);
             buzzer.accessDenied();
-            queueLog(createLog("DENY", response.reason, card.card_id, card.card_uid));
+            queueLog(ACCESS_LOG_DENY, response.reason, card.card_id, card.card_uid, tap.door);
         }
     }
+}
+
+void AccessController::decideOffline(Tap& tap) {
+    CardData& card = *tap.card;
+    
+    // Offline mode - verify JWT and check whitelist
+    LOG_I("OFFLINE", "API unavailable - verifying JWT");
     
+    // Credential was skipped for the online check, read it now
+    if (!card.has_credential) {
+        doors[tap.door].nfc->readCredential(card);
+    }
+    
+    if (checkOfflineWhitelist(card.card_id, card)) {
+        // Card is authorized via JWT verification
+        LOG_I("OFFLINE", "Access granted for: %s", card.card_id.c_str());
+        
+        lcd.show("OFFLINE MODE", "Access granted");
+        grantTapAccess(tap, "OFFLINE_WHITELIST");
+        queueLog(ACCESS_LOG_ALLOW, "OFFLINE_WHITELIST", card.card_id, card.card_uid, tap.door);
+    } else {
+        // JWT verification failed or not in whitelist
+        LOG_I("OFFLINE", "Access denied");
+        lcd.show("OFFLINE", "Access denied");
+        buzzer.accessDenied();
+        queueLog(ACCESS_LOG_DENY, "OFFLINE_NOT_WHITELISTED", card.card_id, card.card_uid, tap.door);
+    }
+}
+
+void AccessController::grantTapAccess(Tap& tap, const String& reason) {
+    grantAccess(reason, tap.door);
+    LOG_D("PERF", "Tap to unlock: %lums", (unsigned long)(millis() - tap.card->detected_ms));
+}
+
+void AccessController::completeTap(Tap& tap, const Credential* fresh) {
+    if (fresh != NULL) {
+        rememberWriteBack(tap.card->card_id, tap.card->card_uid, *fresh);
+    }
+    
+    int slot = findWriteBack(tap.card->card_id, tap.card->card_uid);
+    if (slot >= 0) {
+        if (needsCredentialWrite(*tap.card, pendingWrites[slot].credential)) {
+            // Card is still selected, write on the next update()
+            tap.state = TAP_WRITEBACK;
+            return;
+        }
+        
+        LOG_D("PERF", "Credential unchanged, skipping write");
+        pendingWrites[slot].card_id = "";
+    }
+    
+    finishTap(tap);
+}
+
+void AccessController::writeBack(Tap& tap) {
+    tap.state = TAP_IDLE;
+    
+    int slot = findWriteBack(tap.card->card_id, tap.card->card_uid);
+    if (slot >= 0) {
+        lcd.show("Updating card", "Keep on reader!");
+        
+        uint32_t writeStartMs = millis();
+        if (doors[tap.door].nfc->writeCredential(pendingWrites[slot].credential)) {
+            LOG_D("PERF", "Credential write: %lums", (unsigned long)(millis() - writeStartMs));
+            lcd.show("Card updated!", "Welcome");
+            pendingWrites[slot].card_id = "";
+        } else {
+            // Most likely pulled away early, kept for the next tap
+            LOG_W("NFC", "Failed to write credential, retry on next tap");
+            lcd.show("Update pending", "Tap again later");
+        }
+    }
+    
+    finishTap(tap);
+}
+
+void AccessController::finishTap(Tap& tap) {
     // CRITICAL: Always halt card to prevent blocking reader
-    nfc.haltCard();
+    doors[tap.door].nfc->haltCard();
+    delete tap.card;
+    tap.card = NULL;
+    tap.state = TAP_IDLE;
     
-    uint32_t totalMs = millis() - stepStartMs;
-    Serial.print("[PERF] Total access check: ");
-    Serial.print(totalMs);
-    Serial.println("ms");
+    // Card is halted, the task may use the reader again
+    nfcTask.releaseReader(tap.door);
 }
 
-void AccessController::grantAccess(const String& reason) {
-    buzzer.accessGranted();
-    doorMonitor.notifyAccessGranted();
-    Serial.print("[ACCESS] Access granted: ");
-    Serial.println(reason);
+void AccessController::showFeedback(const String& line1, const String& line2, uint32_t holdMs,
+                                    const String& next1, const String& next2) {
+    lcd.show(line1, line2);
+    feedbackNext1 = next1;
+    feedbackNext2 = next2;
+    feedbackUntilMs = millis() + holdMs;
+    feedbackActive = true;
 }
 
+bool AccessController::applyCachedDecision(Tap& tap) {
+    uint8_t key[DECISION_CACHE_KEY_LEN];
+    DecisionCache::makeKey(tap.request, key);
+    
+    bool allow;
+    String userName;
+    if (!decisionCache.lookup(key, allow, userName)) {
+        return false;
+    }
+    
+    LOG_I("ACCESS", "%s (cached)", allow ? "ALLOWED" : "DENIED");
+    if (allow) {
+        lcd.show("Welcome", userName.length() > 0 ? userName : String("Access granted"));
+        grantTapAccess(tap, "DECISION_CACHE");
+    } else {
+        lcd.show("Access denied", "Try later");
+        buzzer.accessDenied();
+    }
+    queueLog(allow ? ACCESS_LOG_ALLOW : ACCESS_LOG_DENY, "DECISION_CACHE",
+             tap.card->card_id, tap.card->card_uid, tap.door);
+    return true;
+}
 
+void AccessController::reconcileLateChecks() {
+    for (uint8_t door = 0; door < doorCount; door++) {
+        // A deciding tap's own answer must reach pollDecision()
+        uint32_t awaited = taps[door].state == TAP_DECIDING ? taps[door].ticket : 0;
+        
+        AccessCheckJob* job;
+        while ((job = doors[door].checkTask->takeLate(awaited)) != NULL) {
+            bool hedged = takeHedge(door, job->ticket);
+            if (!job->success) {
+                LOG_W("HEDGE", "Late server check failed for %s", job->request.card_id.c_str());
+            } else if (hedged) {
+                // Not a second decision: whether the server agrees with the
+                // LOCAL_HEDGE entry already logged for this tap
+                bool confirmed = job->response.result == "ALLOW";
+                if (!confirmed) {
+                    LOG_W("HEDGE", "Server denied %s after local decision (%s)",
+                          job->request.card_id.c_str(), job->response.reason.c_str());
+                }
+                queueLog(confirmed ? ACCESS_LOG_ALLOW : ACCESS_LOG_DENY,
+                         confirmed ? "HEDGE_CONFIRMED" : "HEDGE_OVERRULED",
+                         job->request.card_id, job->request.card_uid, door);
+            } else {
+                // Tap already timed out and logged SERVER_ERROR
+                LOG_W("HEDGE", "Server answered %s after the tap gave up (%s)",
+                      job->request.card_id.c_str(), job->response.result.c_str());
+            }
+            
+            // Rotation answered after the card was gone: write it on the next tap
+            if (job->success && job->response.has_credential && !isCardRecovery(job->response)) {
+                rememberWriteBack(job->request.card_id, job->request.card_uid, job->response.credential);
+            }
+            delete job;
+        }
+    }
+}
 
-void AccessController::queueLog(const LogEntry& log) {
-    if (logQueueCount >= LOG_QUEUE_SIZE) {
-        Serial.println("[LOG] Queue full, dropping oldest");
-        // Shift array left
-        for (int i = 1; i < LOG_QUEUE_SIZE; i++) {
-            logQueue[i - 1] = logQueue[i];
+void AccessController::rememberHedge(uint8_t door, uint32_t ticket) {
+    if (ticket == 0) return;
+    
+    // Oldest entry goes first, its answer is long overdue
+    hedgedTickets[door][hedgedNext[door]] = ticket;
+    hedgedNext[door] = (hedgedNext[door] + 1) % ACCESS_CHECK_QUEUE_DEPTH;
+}
+
+bool AccessController::takeHedge(uint8_t door, uint32_t ticket) {
+    for (int i = 0; i < ACCESS_CHECK_QUEUE_DEPTH; i++) {
+        if (hedgedTickets[door][i] == ticket) {
+            hedgedTickets[door][i] = 0;
+            return true;
         }
-        logQueueCount--;
     }
+    return false;
+}
+
+void AccessController::grantAccess(const String& reason, uint8_t door) {
+    if (door >= doorCount) door = 0;
     
-    logQueue[logQueueCount++] = log;
+    buzzer.accessGranted();
+    doors[door].monitor->notifyAccessGranted();
+    LOG_I("ACCESS", "Access granted (%s): %s", doors[door].doorId, reason.c_str());
+}
+
+
+
+void AccessController::queueLog(uint8_t decision, const String& reason,
+                                const String& card_id, const String& card_uid, uint8_t door) {
+    logQueue.push(decision, reason, card_id, card_uid, door);
+    lastLogMs = millis();
+}
+
+void AccessController::flushLogs() {
+    if (!journal.isReady() || logQueue.count() == 0) return;
+    
+    AccessLogRecord batch[8];
+    int n;
+    while ((n = logQueue.peek(batch, 8)) > 0) {
+        if (!journal.append(batch, n, logQueue)) {
+            return;     // Stays in RAM, retried next time
+        }
+        logQueue.release(batch[n - 1].seq);
+    }
 }
 
 int AccessController::getQueuedLogCount() const {
-    return logQueueCount;
+    return logQueue.count() + journal.pendingCount();
+}
+
+uint32_t AccessController::getDroppedLogCount() const {
+    return logQueue.getDropped();
+}
+
+void AccessController::getVerifyCacheStats(uint32_t& hits, uint32_t& misses) const {
+    hits = verifiedCache.getHits();
+    misses = verifiedCache.getMisses();
+}
+
+uint32_t AccessController::getOfflineStoreGeneration() const {
+    return store.getGeneration();
+}
+
+void AccessController::scheduleLogUpload() {
+    int pending = getQueuedLogCount();
+    if (pending == 0 || api.isOffline()) return;
+    
+    uint32_t now = millis();
+    if (uploadFailed && now - lastUploadFailMs < LOG_UPLOAD_RETRY_MS) return;
+    
+    // Soon after a burst of taps, or once things are quiet
+    if (pending >= LOG_UPLOAD_WATERMARK || now - lastLogMs >= LOG_UPLOAD_IDLE_MS) {
+        uploadQueuedLogs();
+    }
 }
 
 bool AccessController::uploadQueuedLogs() {
-    if (logQueueCount == 0) return true;
+    flushLogs();
     
-    Serial.print("[LOG] Uploading ");
-    Serial.print(logQueueCount);
-    Serial.println(" logs");
+    int total = 0;
+    for (int batch = 0; batch < LOG_UPLOAD_BURST; batch++) {
+        if (getQueuedLogCount() == 0) break;
+        
+        // A tap waiting on the reader goes first, the rest is sent later
+        if (batch > 0 && nfcTask.waitForCard(0)) break;
+        
+        bool moreToFollow = batch + 1 < LOG_UPLOAD_BURST && getQueuedLogCount() > LOG_BATCH_SIZE;
+        int sent = 0;
+        if (!uploadLogBatch(moreToFollow, sent)) {
+            LOG_W("LOG", "Upload failed after %d logs", total);
+            uploadFailed = true;
+            lastUploadFailMs = millis();
+            return false;
+        }
+        if (sent == 0) break;
+        total += sent;
+    }
     
-    if (api.uploadLogs(logQueue, logQueueCount)) {
-        Serial.println("[LOG] Upload successful");
-        logQueueCount = 0;
-        return true;
+    uploadFailed = false;
+    if (total > 0) {
+        LOG_D("LOG", "Uploaded %d logs, %d pending", total, getQueuedLogCount());
+    }
+    return true;
+}
+
+bool AccessController::uploadLogBatch(bool moreToFollow, int& sent) {
+    JsonDocument requestDoc;
+    JsonArray logs = requestDoc["logs"].to<JsonArray>();
+    
+    // Oldest first; the journal when mounted, otherwise the RAM queue
+    uint32_t lastSeq = 0;
+    sent = journal.isReady() ? journal.toJson(logs, LOG_BATCH_SIZE, lastSeq, logQueue)
+                             : logQueue.toJson(logs, LOG_BATCH_SIZE, lastSeq);
+    if (sent == 0) return true;
+    
+    if (!api.uploadLogs(requestDoc, moreToFollow)) {
+        sent = 0;
+        return false;
     }
     
-    Serial.println("[LOG] Upload failed");
-    return false;
+    // Acknowledged per batch: a later failure does not resend these
+    if (journal.isReady()) {
+        journal.acknowledge(lastSeq);
+    } else {
+        logQueue.release(lastSeq);
+    }
+    return true;
 }
 
-LogEntry AccessController::createLog(const String& decision, const String& reason,
-                                      const String& card_id, const String& card_uid) {
-    LogEntry log;
-    log.ts = api.getTimestamp();
-    log.door_id = DOOR_ID;
-    log.card_id = card_id;
-    log.card_uid = card_uid;
-    log.decision = decision;
-    log.reason = reason;
-    return log;
+uint8_t AccessController::keyAlg(const JwtVerificationConfig& key) {
+    // Older backends send no alg, their keys are Ed25519
+    if (key.alg.length() == 0) return CREDENTIAL_ALG_EDDSA;
+    return CredentialCodec::algFromName(key.alg.c_str());
+}
+
+void AccessController::loadKeyRing(const JwtVerificationConfig* keys, int keyCount) {
+    // Parse JWT public keys once for offline verification: the current key
+    // (keys[0], also used for tokens without kid) plus retired keys until they expire
+    keyRing.clear();
+    for (int i = 0; i < keyCount; i++) {
+        if (keys[i].public_key_pem.length() == 0) continue;
+        keyRing.add(keys[i].kid, keyAlg(keys[i]), keys[i].public_key_pem,
+                    i == 0 ? 0 : keys[i].expires_at, i == 0);
+    }
 }
 
-void AccessController::updateConfig(const DeviceConfig& config) {
-    // Update offline whitelist
-    whitelistCount = config.whitelist_count;
-    if (whitelistCount > 50) whitelistCount = 50;  // Safety limit
+void AccessController::updateConfig(DeviceConfig& config) {
+    // Answers given under the previous config may no longer hold
+    decisionCache.clear();
+    decisionCache.setMaxTtl(config.decision_cache_max_ttl_sec);
+    
+    // Update offline whitelist (the old index is freed with config)
+    whitelist.swap(config.whitelist);
+    
+    JwtVerificationConfig keys[JWT_KEYRING_SIZE];
+    int keyCount = 0;
+    keys[keyCount++] = config.jwt_verification;
+    for (int i = 0; i < config.jwt_retired_key_count && keyCount < JWT_KEYRING_SIZE; i++) {
+        keys[keyCount++] = config.jwt_retired_keys[i];
+    }
+    loadKeyRing(keys, keyCount);
     
-    for (int i = 0; i < whitelistCount; i++) {
-        whitelist[i] = config.whitelist[i];
+    // Persist, then search the flash copy so the RAM index can go
+    if (store.save(whitelist, keys, keyCount)) {
+        whitelist.attach(store.getEntries(), store.getEntryCount());
     }
     
-    // Store JWT public key for offline verification
-    jwtPublicKeyPem = config.jwt_verification.public_key_pem;
+    LOG_I("CONFIG", "Whitelist updated: %u entries, %u bytes RAM",
+          (unsigned)whitelist.size(), (unsigned)whitelist.memoryBytes());
+    LOG_I("CONFIG", "JWT key ring: %d key(s) for offline verification", keyRing.getCount());
     
-    Serial.print("[CONFIG] Whitelist updated: ");
-    Serial.print(whitelistCount);
-    Serial.println(" entries");
-    Serial.println("[CONFIG] JWT public key stored for offline verification");
+    // Remote log level (logging is per device, so it rides on the config refresh)
+    if (config.log_level >= 0) {
+        Log::setLevel(config.log_level);
+    }
 }
 
 bool AccessController::checkOfflineWhitelist(const String& card_id, const CardData& card) {
     // Offline: Verify JWT and card binding
     if (!card.has_credential) {
-        Serial.println("[OFFLINE] No JWT - denied");
+        LOG_I("OFFLINE", "No JWT - denied");
         return false;
     }
     
-    Serial.println("[OFFLINE] Verifying JWT");
-    JWTVerifier verifier;
-    JWTPayload payload;
+    // Header kid picks the key, no trial verification against each one
+    char kid[JWT_KID_MAX_LEN + 1];
+    size_t kidLen = CredentialCodec::headerKid(card.credential_bin, card.credential_bin_len, kid, sizeof(kid));
+    if (kidLen == 0) kid[0] = '\0';
     
-    if (!verifier.verify(card.credential.raw, jwtPublicKeyPem, payload)) {
-        Serial.println("[OFFLINE] JWT verification failed");
+    const JWTPublicKey* publicKey = keyRing.find(kid, kidLen, KeyRing::clockNow());
+    if (publicKey == NULL) {
+        LOG_W("OFFLINE", "No usable key for kid '%s'", kid);
         return false;
     }
     
+    JWTPayload payload;
+    
+    // Same credential on the same card verified before: skip the signature check
+    uint8_t cacheKey[VERIFIED_CACHE_KEY_LEN];
+    VerifiedCredentialCache::makeKey(card.credential_bin, card.credential_bin_len, card.card_uid,
+                                     *publicKey, cacheKey);
+    
+    if (verifiedCache.lookup(cacheKey, payload)) {
+        LOG_D("OFFLINE", "JWT verified (cached), hit rate %lu/%lu",
+              (unsigned long)verifiedCache.getHits(),
+              (unsigned long)(verifiedCache.getHits() + verifiedCache.getMisses()));
+    } else {
+        LOG_D("OFFLINE", "Verifying JWT");
+        
+        // Digest from the read covers M only, usable for an ES256 key
+        bool verified;
+        if (card.has_signing_digest && publicKey->alg == CREDENTIAL_ALG_ES256) {
+            verified = verifier.verifyCompactDigest(card.credential_bin, card.credential_bin_len,
+                                                    card.signing_digest, *publicKey, payload);
+        } else if (card.credential.format == "jwt-bin") {
+            verified = verifier.verifyCompact(card.credential_bin, card.credential_bin_len, *publicKey, payload);
+        } else {
+            verified = verifier.verify(card.credential.raw, *publicKey, payload);
+        }
+        
+        if (!verified) {
+            LOG_W("OFFLINE", "JWT verification failed");
+            return false;
+        }
+        
+        // Claims are re-checked below on every tap, only the signature is cached
+        verifiedCache.insert(cacheKey, payload);
+    }
+    
     // Verify JWT matches card
     if (payload.card_uid != card.card_uid) {
-        Serial.print("[OFFLINE] JWT card_uid mismatch - JWT: ");
-        Serial.print(payload.card_uid);
-        Serial.print(", Card: ");
-        Serial.println(card.card_uid);
-        Serial.println("[OFFLINE] Possible replay attack detected!");
+        LOG_W("OFFLINE", "JWT card_uid mismatch - JWT: %s, Card: %s",
+              payload.card_uid.c_str(), card.card_uid.c_str());
+        LOG_W("OFFLINE", "Possible replay attack detected!");
         return false;
     }
     
     if (payload.card_id != card.card_id) {
-        Serial.print("[OFFLINE] JWT card_id mismatch - JWT: ");
-        Serial.print(payload.card_id);
-        Serial.print(", Card: ");
-        Serial.println(card.card_id);
-        Serial.println("[OFFLINE] Possible replay attack detected!");
+        LOG_W("OFFLINE", "JWT card_id mismatch - JWT: %s, Card: %s",
+              payload.card_id.c_str(), card.card_id.c_str());
+        LOG_W("OFFLINE", "Possible replay attack detected!");
         return false;
     }
     
-    Serial.println("[OFFLINE] JWT bound to card verified");
+    LOG_D("OFFLINE", "JWT bound to card verified");
     
     // Check expiration
     unsigned long currentTime = millis() / 1000;
     if (payload.exp > 0 && currentTime > payload.exp) {
-        Serial.println("[OFFLINE] JWT expired");
+        LOG_I("OFFLINE", "JWT expired");
         return false;
     }
     
     // Check offline_max_until
     if (payload.offline_max_until > 0 && currentTime > payload.offline_max_until) {
-        Serial.println("[OFFLINE] JWT offline period expired");
+        LOG_I("OFFLINE", "JWT offline period expired");
         return false;
     }
     
     // JWT is valid - check extracted card_id against whitelist
-    Serial.print("[OFFLINE] JWT valid, card_id: ");
-    Serial.println(payload.card_id);
+    LOG_D("OFFLINE", "JWT valid, card_id: %s", payload.card_id.c_str());
     
-    for (int i = 0; i < whitelistCount; i++) {
-        if (whitelist[i].card_id == payload.card_id) {
-            Serial.print("[OFFLINE] Card authorized, user: ");
-            Serial.println(payload.user_id);
-            return true;
+    uint32_t validUntil = 0;
+    if (!whitelist.find(payload.card_id.c_str(), payload.card_id.length(), validUntil)) {
+        LOG_I("OFFLINE", "Card not in whitelist");
+        return false;
+    }
+    
+    // Entry expiry needs a synced clock, without one the signed exp above still applies
+    uint32_t now = KeyRing::clockNow();
+    if (validUntil != 0 && now != 0 && now > validUntil) {
+        LOG_I("OFFLINE", "Whitelist entry expired");
+        return false;
+    }
+    
+    LOG_I("OFFLINE", "Card authorized, user: %s", payload.user_id.c_str());
+    return true;
+}
+
+void AccessController::rememberWriteBack(const String& card_id, const String& card_uid,
+                                         const Credential& credential) {
+    int slot = findWriteBack(card_id, card_uid);
+    if (slot < 0) {
+        // Free slot, else the oldest one
+        slot = 0;
+        for (int i = 0; i < PENDING_WRITEBACK_SLOTS; i++) {
+            if (pendingWrites[i].card_id.length() == 0) {
+                slot = i;
+                break;
+            }
+            if ((int32_t)(pendingWrites[i].queuedMs - pendingWrites[slot].queuedMs) < 0) {
+                slot = i;
+            }
+        }
+        if (pendingWrites[slot].card_id.length() > 0) {
+            LOG_W("NFC", "Write-back table full, dropping %s", pendingWrites[slot].card_id.c_str());
         }
     }
     
-    Serial.println("[OFFLINE] Card not in whitelist");
-    return false;
+    pendingWrites[slot].card_id = card_id;
+    pendingWrites[slot].card_uid = card_uid;
+    pendingWrites[slot].credential = credential;
+    pendingWrites[slot].queuedMs = millis();
+}
+
+int AccessController::findWriteBack(const String& card_id, const String& card_uid) {
+    for (int i = 0; i < PENDING_WRITEBACK_SLOTS; i++) {
+        if (pendingWrites[i].card_id.length() == 0 || pendingWrites[i].card_id != card_id) {
+            continue;
+        }
+        if (pendingWrites[i].card_uid == card_uid) {
+            return i;
+        }
+        
+        // Same card_id on another card (cloned or re-issued): the credential
+        // is bound to the old UID, never write it here
+        LOG_W("NFC", "Write-back for %s was for UID %s, dropped", card_id.c_str(),
+              pendingWrites[i].card_uid.c_str());
+        pendingWrites[i].card_id = "";
+    }
+    return -1;
+}
+
+void AccessController::forgetWriteBack(const String& card_id) {
+    for (int i = 0; i < PENDING_WRITEBACK_SLOTS; i++) {
+        if (pendingWrites[i].card_id == card_id) {
+            pendingWrites[i].card_id = "";
+        }
+    }
+}
+
+bool AccessController::needsCredentialWrite(const CardData& card, const Credential& credential) {
+    // Header alone is enough to compare
+    bool cardHasCredential = card.has_credential || (card.has_header && card.credential_len > 0);
+    return !cardHasCredential || !isSameCredential(card, credential);
 }
 
+bool AccessController::isSameCredential(const CardData& card, const Credential& credential) {
+    // Credential not read: compare what would be stored against the header hash
+    if (!card.has_credential) {
+        uint8_t compact[CREDENTIAL_MAX_BYTES];
+        size_t len = CredentialCodec::encode(credential.raw, compact, sizeof(compact));
+        uint32_t hash = len > 0
+            ? CredentialCodec::hash(compact, len)
+            : CredentialCodec::hash((const uint8_t*)credential.raw.c_str(), credential.raw.length());
+        if (len == 0) len = credential.raw.length();
+        return len == card.credential_len && hash == card.credential_hash;
+    }
+    
+    // Legacy cards hold the JWT text
+    if (card.credential.format != "jwt-bin") {
+        return card.credential.raw == credential.raw;
+    }
+    
+    // Compact cards: compare the encoded form byte for byte
+    uint8_t compact[CREDENTIAL_MAX_BYTES];
+    size_t len = CredentialCodec::encode(credential.raw, compact, sizeof(compact));
+    return len > 0 && len == card.credential_bin_len && memcmp(compact, card.credential_bin, len) == 0;
+}
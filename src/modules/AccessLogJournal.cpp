@@ -0,0 +1,345 @@
+#include "AccessLogJournal.h"
+#include <LittleFS.h>
+
+#define LOG_MODULE_LEVEL LOG_LEVEL_API
+#include "Log.h"
+
+#define JOURNAL_CURSOR_FILE ACCESS_LOG_DIR "/cursor"
+#define JOURNAL_REASONS_FILE ACCESS_LOG_DIR "/reasons"
+#define JOURNAL_BOOT_FILE ACCESS_LOG_DIR "/boot"
+#define JOURNAL_READ_CHUNK 8
+
+static const size_t RECORD_SIZE = sizeof(AccessLogRecord);
+
+AccessLogJournal::AccessLogJournal()
+    : segmentCount(0), ackedSeq(0), lastSeq(0), savedReasons(0), ready(false) {
+}
+
+bool AccessLogJournal::begin(AccessLogQueue& queue) {
+    // Formats on first boot (takes a few seconds once)
+    if (!LittleFS.begin(true)) {
+        LOG_E("JOURNAL", "LittleFS mount failed, logs kept in RAM only");
+        return false;
+    }
+    if (!LittleFS.exists(ACCESS_LOG_DIR)) {
+        LittleFS.mkdir(ACCESS_LOG_DIR);
+    }
+    
+    File cursor = LittleFS.open(JOURNAL_CURSOR_FILE, FILE_READ);
+    if (cursor) {
+        uint32_t data[2];
+        if (cursor.read((uint8_t*)data, sizeof(data)) == sizeof(data) && data[0] == ~data[1]) {
+            ackedSeq = data[0];
+        }
+        cursor.close();
+    }
+    
+    if (!scanSegments()) {
+        return false;
+    }
+    
+    lastSeq = ackedSeq;
+    if (segmentCount > 0 && (int32_t)(segments[segmentCount - 1].lastSeq - lastSeq) > 0) {
+        lastSeq = segments[segmentCount - 1].lastSeq;
+    }
+    
+    // Stored records refer to reason codes by index, restore the same table
+    String names[ACCESS_LOG_REASON_MAX];
+    savedReasons = loadReasons(names, ACCESS_LOG_REASON_MAX);
+    queue.loadReasons(names, savedReasons);
+    queue.setNextSeq(lastSeq + 1);
+    queue.setBoot((uint16_t)nextBoot());
+    
+    ready = true;
+    
+    // Segments acknowledged just before the last reset
+    compact();
+    
+    LOG_I("JOURNAL", "%d segment(s), %lu record(s) not uploaded",
+          segmentCount, (unsigned long)pendingCount());
+    return true;
+}
+
+bool AccessLogJournal::isReady() const {
+    return ready;
+}
+
+bool AccessLogJournal::append(const AccessLogRecord* records, int count, const AccessLogQueue& queue) {
+    if (!ready) return false;
+    
+    // New reason codes must be on flash before records that use them
+    if (queue.getReasonCount() > savedReasons && !saveReasons(queue)) {
+        return false;
+    }
+    
+    int i = 0;
+    while (i < count) {
+        if (segmentCount == 0 || segments[segmentCount - 1].sealed ||
+            segments[segmentCount - 1].records >= ACCESS_LOG_SEGMENT_RECORDS) {
+            startSegment();
+        }
+        
+        Segment& segment = segments[segmentCount - 1];
+        int n = count - i;
+        if (n > (int)(ACCESS_LOG_SEGMENT_RECORDS - segment.records)) {
+            n = ACCESS_LOG_SEGMENT_RECORDS - segment.records;
+        }
+        
+        // One open/write/close per batch: LittleFS commits on close
+        File file = LittleFS.open(segmentPath(segment.id), FILE_APPEND);
+        size_t written = file ? file.write((const uint8_t*)&records[i], n * RECORD_SIZE) : 0;
+        if (file) file.close();
+        
+        if (written != n * RECORD_SIZE) {
+            LOG_E("JOURNAL", "Write failed (segment %lu)", (unsigned long)segment.id);
+            segment.sealed = true;
+            return false;
+        }
+        
+        if (segment.records == 0) {
+            segment.firstSeq = records[i].seq;
+        }
+        segment.records += n;
+        segment.lastSeq = records[i + n - 1].seq;
+        lastSeq = segment.lastSeq;
+        i += n;
+    }
+    
+    return true;
+}
+
+int AccessLogJournal::toJson(JsonArray out, int maxCount, uint32_t& lastSeqOut, const AccessLogQueue& queue) {
+    if (!ready) return 0;
+    
+    AccessLogRecord chunk[JOURNAL_READ_CHUNK];
+    int written = 0;
+    bool readError = false;
+    
+    // Stops at the first segment that cannot be read: records after it would
+    // move the upload cursor past the ones still on flash
+    for (int s = 0; s < segmentCount && written < maxCount && !readError; s++) {
+        const Segment& segment = segments[s];
+        if (segment.records == 0 || (int32_t)(segment.lastSeq - ackedSeq) <= 0) {
+            continue;
+        }
+        
+        File file = LittleFS.open(segmentPath(segment.id), FILE_READ);
+        if (!file) {
+            LOG_E("JOURNAL", "Cannot open segment %lu", (unsigned long)segment.id);
+            readError = true;
+            break;
+        }
+        
+        uint32_t left = segment.records;
+        while (left > 0 && written < maxCount) {
+            int n = left < JOURNAL_READ_CHUNK ? left : JOURNAL_READ_CHUNK;
+            if (file.read((uint8_t*)chunk, n * RECORD_SIZE) != n * RECORD_SIZE) {
+                LOG_E("JOURNAL", "Short read (segment %lu)", (unsigned long)segment.id);
+                readError = true;
+                break;
+            }
+            left -= n;
+            
+            for (int i = 0; i < n && written < maxCount; i++) {
+                if ((int32_t)(chunk[i].seq - ackedSeq) <= 0) continue;
+                queue.appendJson(out, chunk[i]);
+                lastSeqOut = chunk[i].seq;
+                written++;
+            }
+        }
+        file.close();
+    }
+    
+    // Every pending record was read and none is left: only gaps (records
+    // overwritten in RAM before reaching flash). Not after a failed read
+    if (written == 0 && !readError && pendingCount() > 0) {
+        acknowledge(lastSeq);
+    }
+    
+    return written;
+}
+
+void AccessLogJournal::acknowledge(uint32_t seq) {
+    if (!ready || (int32_t)(seq - ackedSeq) <= 0) return;
+    
+    ackedSeq = seq;
+    saveCursor();
+    compact();
+}
+
+void AccessLogJournal::compact() {
+    // Whole segments go once every record in them is uploaded
+    while (segmentCount > 0 && segments[0].records > 0 &&
+           (int32_t)(segments[0].lastSeq - ackedSeq) <= 0) {
+        LittleFS.remove(segmentPath(segments[0].id));
+        memmove(&segments[0], &segments[1], (segmentCount - 1) * sizeof(Segment));
+        segmentCount--;
+    }
+}
+
+uint32_t AccessLogJournal::pendingCount() const {
+    return ready ? lastSeq - ackedSeq : 0;
+}
+
+bool AccessLogJournal::scanSegments() {
+    File dir = LittleFS.open(ACCESS_LOG_DIR);
+    if (!dir || !dir.isDirectory()) {
+        LOG_E("JOURNAL", "Cannot open %s", ACCESS_LOG_DIR);
+        return false;
+    }
+    
+    segmentCount = 0;
+    File file = dir.openNextFile();
+    while (file) {
+        // name() is the bare name on core 2.x, the full path on older cores
+        String name = file.name();
+        name = name.substring(name.lastIndexOf('/') + 1);
+        
+        if (name.endsWith(".seg")) {
+            Segment segment;
+            segment.id = strtoul(name.c_str(), NULL, 16);
+            segment.records = file.size() / RECORD_SIZE;
+            segment.sealed = file.size() % RECORD_SIZE != 0;
+            segment.firstSeq = 0;
+            segment.lastSeq = 0;
+            
+            AccessLogRecord record;
+            if (segment.records > 0 && file.read((uint8_t*)&record, RECORD_SIZE) == RECORD_SIZE) {
+                segment.firstSeq = record.seq;
+                file.seek((segment.records - 1) * RECORD_SIZE);
+                if (file.read((uint8_t*)&record, RECORD_SIZE) == RECORD_SIZE) {
+                    segment.lastSeq = record.seq;
+                }
+            }
+            
+            String path = segmentPath(segment.id);
+            file.close();
+            
+            if (segment.records == 0 || segmentCount == ACCESS_LOG_MAX_SEGMENTS) {
+                LittleFS.remove(path);
+            } else {
+                // Keep sorted by id (insertion, few entries)
+                int pos = segmentCount++;
+                while (pos > 0 && segments[pos - 1].id > segment.id) {
+                    segments[pos] = segments[pos - 1];
+                    pos--;
+                }
+                segments[pos] = segment;
+            }
+        } else {
+            file.close();
+        }
+        
+        file = dir.openNextFile();
+    }
+    dir.close();
+    return true;
+}
+
+bool AccessLogJournal::startSegment() {
+    if (segmentCount == ACCESS_LOG_MAX_SEGMENTS) {
+        dropOldestSegment();
+    }
+    
+    Segment& segment = segments[segmentCount];
+    segment.id = segmentCount > 0 ? segments[segmentCount - 1].id + 1 : 1;
+    segment.firstSeq = 0;
+    segment.lastSeq = 0;
+    segment.records = 0;
+    segment.sealed = false;
+    segmentCount++;
+    return true;
+}
+
+void AccessLogJournal::dropOldestSegment() {
+    const Segment& oldest = segments[0];
+    
+    if ((int32_t)(oldest.lastSeq - ackedSeq) > 0) {
+        LOG_W("JOURNAL", "Journal full, dropping %lu record(s) not uploaded",
+              (unsigned long)oldest.records);
+        ackedSeq = oldest.lastSeq;
+        saveCursor();
+    }
+    
+    LittleFS.remove(segmentPath(oldest.id));
+    memmove(&segments[0], &segments[1], (segmentCount - 1) * sizeof(Segment));
+    segmentCount--;
+}
+
+bool AccessLogJournal::saveCursor() {
+    uint32_t data[2] = {ackedSeq, ~ackedSeq};
+    return replaceFile(JOURNAL_CURSOR_FILE, (const uint8_t*)data, sizeof(data));
+}
+
+uint32_t AccessLogJournal::nextBoot() {
+    uint32_t boot = 0;
+    File file = LittleFS.open(JOURNAL_BOOT_FILE, FILE_READ);
+    if (file) {
+        uint32_t data[2];
+        if (file.read((uint8_t*)data, sizeof(data)) == sizeof(data) && data[0] == ~data[1]) {
+            boot = data[0];
+        }
+        file.close();
+    }
+    
+    // Missing or torn file restarts the count
+    boot++;
+    uint32_t data[2] = {boot, ~boot};
+    if (!replaceFile(JOURNAL_BOOT_FILE, (const uint8_t*)data, sizeof(data))) {
+        LOG_W("JOURNAL", "Failed to save boot counter");
+    }
+    return boot;
+}
+
+bool AccessLogJournal::saveReasons(const AccessLogQueue& queue) {
+    String text;
+    int count = queue.getReasonCount();
+    for (int i = 0; i < count; i++) {
+        text += queue.getReason(i);
+        text += '\n';
+    }
+    
+    if (!replaceFile(JOURNAL_REASONS_FILE, (const uint8_t*)text.c_str(), text.length())) {
+        LOG_E("JOURNAL", "Failed to save reason table");
+        return false;
+    }
+    savedReasons = count;
+    return true;
+}
+
+int AccessLogJournal::loadReasons(String* names, int maxNames) {
+    File file = LittleFS.open(JOURNAL_REASONS_FILE, FILE_READ);
+    if (!file) return 0;
+    
+    int count = 0;
+    while (file.available() && count < maxNames) {
+        String line = file.readStringUntil('\n');
+        line.trim();
+        if (line.length() == 0) break;
+        names[count++] = line;
+    }
+    file.close();
+    return count;
+}
+
+String AccessLogJournal::segmentPath(uint32_t id) {
+    char path[32];
+    snprintf(path, sizeof(path), "%s/%08lx.seg", ACCESS_LOG_DIR, (unsigned long)id);
+    return String(path);
+}
+
+bool AccessLogJournal::replaceFile(const char* path, const uint8_t* data, size_t len) {
+    // Write aside, then rename: a reset leaves either the old or the new file
+    String tmp = String(path) + ".tmp";
+    File file = LittleFS.open(tmp, FILE_WRITE);
+    if (!file) return false;
+    
+    size_t written = file.write(data, len);
+    file.close();
+    if (written != len) {
+        LittleFS.remove(tmp);
+        return false;
+    }
+    
+    return LittleFS.rename(tmp, String(path));
+}
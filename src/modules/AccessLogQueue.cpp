@@ -0,0 +1,237 @@
+#include "AccessLogQueue.h"
+#include <time.h>
+
+#define LOG_MODULE_LEVEL LOG_LEVEL_API
+#include "Log.h"
+
+// Reasons produced by the firmware itself, interned up front
+static const char* const BUILTIN_REASONS[] = {
+    "OTHER",
+    "ACCESS_GRANTED",
+    "BUTTON_PRESS",
+    "REMOTE_COMMAND",
+    "SERVER_ERROR",
+    "OFFLINE_WHITELIST",
+    "OFFLINE_NOT_WHITELISTED",
+    "CARD_NOT_FOUND",
+    "CARD_DELETED",
+    "CARD_CLEARED_FOR_REENROLL",
+    "LOCAL_HEDGE",
+    "DECISION_CACHE",
+    "CARD_UNREADABLE",
+    "HEDGE_CONFIRMED",
+    "HEDGE_OVERRULED",
+};
+
+AccessLogQueue::AccessLogQueue()
+    : head(0), used(0), nextSeq(1), dropped(0), boot(0), reasonCount(0) {
+    lock = xSemaphoreCreateMutex();
+    
+    for (size_t i = 0; i < sizeof(BUILTIN_REASONS) / sizeof(BUILTIN_REASONS[0]); i++) {
+        strncpy(reasons[reasonCount], BUILTIN_REASONS[i], ACCESS_LOG_REASON_LEN - 1);
+        reasons[reasonCount][ACCESS_LOG_REASON_LEN - 1] = '\0';
+        reasonCount++;
+    }
+    
+    for (int i = 0; i < DOOR_COUNT; i++) {
+        doorIds[i] = DOOR_ID;
+    }
+}
+
+void AccessLogQueue::push(uint8_t decision, const String& reason, const String& cardId, const String& cardUid,
+                          uint8_t door) {
+    // Build the record before taking the lock
+    AccessLogRecord record;
+    memset(&record, 0, sizeof(record));
+    record.decision = decision;
+    record.door = door;
+    
+    time_t now = time(nullptr);
+    record.clockSet = (uint32_t)now > CLOCK_VALID_AFTER;
+    record.ts = record.clockSet ? (uint32_t)now : millis() / 1000;
+    record.boot = boot;
+    
+    record.cardIdLen = cardId.length() < ACCESS_LOG_CARD_ID_LEN ? cardId.length() : ACCESS_LOG_CARD_ID_LEN;
+    memcpy(record.cardId, cardId.c_str(), record.cardIdLen);
+    
+    // UID arrives as hex ("04A1B2C3"), keep the bytes
+    size_t uidLen = cardUid.length() / 2;
+    if (uidLen > ACCESS_LOG_UID_LEN) uidLen = ACCESS_LOG_UID_LEN;
+    for (size_t i = 0; i < uidLen; i++) {
+        char hex[3] = {cardUid[i * 2], cardUid[i * 2 + 1], '\0'};
+        record.uid[i] = (uint8_t)strtoul(hex, NULL, 16);
+    }
+    record.uidLen = uidLen;
+    
+    bool overwrote = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    
+    record.reason = internReason(reason);
+    record.seq = nextSeq++;
+    
+    if (used == LOG_QUEUE_SIZE) {
+        head = (head + 1) % LOG_QUEUE_SIZE;
+        used--;
+        dropped++;
+        overwrote = true;
+    }
+    records[(head + used) % LOG_QUEUE_SIZE] = record;
+    used++;
+    
+    xSemaphoreGive(lock);
+    
+    if (overwrote) {
+        LOG_W("LOG", "Queue full, dropped oldest");
+    }
+}
+
+int AccessLogQueue::toJson(JsonArray out, int maxCount, uint32_t& lastSeq) const {
+    int written = 0;
+    
+    xSemaphoreTake(lock, portMAX_DELAY);
+    
+    for (; written < used && written < maxCount; written++) {
+        const AccessLogRecord& record = records[(head + written) % LOG_QUEUE_SIZE];
+        appendJson(out, record);
+        lastSeq = record.seq;
+    }
+    
+    xSemaphoreGive(lock);
+    return written;
+}
+
+void AccessLogQueue::appendJson(JsonArray out, const AccessLogRecord& record) const {
+    char ts[25];
+    char uid[ACCESS_LOG_UID_LEN * 2 + 1];
+    char cardId[ACCESS_LOG_CARD_ID_LEN + 1];
+    
+    bool synced = formatTime(record, ts, sizeof(ts));
+    for (int i = 0; i < record.uidLen; i++) {
+        snprintf(uid + i * 2, 3, "%02X", record.uid[i]);
+    }
+    uid[record.uidLen * 2] = '\0';
+    memcpy(cardId, record.cardId, record.cardIdLen);
+    cardId[record.cardIdLen] = '\0';
+    
+    // Strings are copied into the document (char arrays, not const char*)
+    JsonObject logObj = out.add<JsonObject>();
+    logObj["ts"] = ts;
+    logObj["door_id"] = doorIds[record.door < DOOR_COUNT ? record.door : 0];
+    logObj["card_id"] = cardId;
+    logObj["card_uid"] = uid;
+    logObj["decision"] = record.decision == ACCESS_LOG_ALLOW ? "ALLOW" : "DENY";
+    logObj["reason"] = getReason(record.reason);
+    if (!synced) {
+        logObj["clock_synced"] = false;     // ts is a placeholder
+    }
+}
+
+void AccessLogQueue::release(uint32_t seq) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    
+    // Records may have been overwritten during the upload, compare by seq
+    while (used > 0 && (int32_t)(records[head].seq - seq) <= 0) {
+        head = (head + 1) % LOG_QUEUE_SIZE;
+        used--;
+    }
+    
+    xSemaphoreGive(lock);
+}
+
+int AccessLogQueue::peek(AccessLogRecord* out, int maxCount) const {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    
+    int n = used < maxCount ? used : maxCount;
+    for (int i = 0; i < n; i++) {
+        out[i] = records[(head + i) % LOG_QUEUE_SIZE];
+    }
+    
+    xSemaphoreGive(lock);
+    return n;
+}
+
+int AccessLogQueue::count() const {
+    return used;
+}
+
+uint32_t AccessLogQueue::getDropped() const {
+    return dropped;
+}
+
+void AccessLogQueue::setNextSeq(uint32_t seq) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    nextSeq = seq;
+    xSemaphoreGive(lock);
+}
+
+void AccessLogQueue::setBoot(uint16_t bootCount) {
+    boot = bootCount;
+}
+
+void AccessLogQueue::loadReasons(const String* names, int count) {
+    if (count <= 0) return;
+    
+    xSemaphoreTake(lock, portMAX_DELAY);
+    
+    // Replaces the table so stored codes keep their meaning
+    reasonCount = 0;
+    for (int i = 0; i < count && i < ACCESS_LOG_REASON_MAX; i++) {
+        strncpy(reasons[i], names[i].c_str(), ACCESS_LOG_REASON_LEN - 1);
+        reasons[i][ACCESS_LOG_REASON_LEN - 1] = '\0';
+        reasonCount++;
+    }
+    
+    xSemaphoreGive(lock);
+}
+
+int AccessLogQueue::getReasonCount() const {
+    return reasonCount;
+}
+
+const char* AccessLogQueue::getReason(uint8_t code) const {
+    // Entries never change once added, no lock needed
+    return code < reasonCount ? reasons[code] : reasons[0];
+}
+
+void AccessLogQueue::setDoorId(uint8_t door, const char* doorId) {
+    if (door < DOOR_COUNT) {
+        doorIds[door] = doorId;
+    }
+}
+
+uint8_t AccessLogQueue::internReason(const String& reason) {
+    // Called with the lock held
+    for (int i = 0; i < reasonCount; i++) {
+        if (strcmp(reasons[i], reason.c_str()) == 0) {
+            return i;
+        }
+    }
+    
+    if (reasonCount == ACCESS_LOG_REASON_MAX || reason.length() >= ACCESS_LOG_REASON_LEN) {
+        return 0;
+    }
+    
+    memcpy(reasons[reasonCount], reason.c_str(), reason.length() + 1);
+    return reasonCount++;
+}
+
+bool AccessLogQueue::formatTime(const AccessLogRecord& record, char* out, size_t maxLen) const {
+    time_t ts = record.ts;
+    
+    if (!record.clockSet) {
+        // Logged before NTP sync: place it relative to now if the clock is set
+        // since. Uptime from an earlier boot (journal) cannot be placed at all
+        time_t now = time(nullptr);
+        uint32_t uptime = millis() / 1000;
+        if ((uint32_t)now <= CLOCK_VALID_AFTER || record.boot != boot || record.ts > uptime) {
+            strncpy(out, "2025-01-01T00:00:00Z", maxLen);  // Same fallback as ApiClient::getTimestamp
+            return false;
+        }
+        ts = now - (uptime - record.ts);
+    }
+    
+    struct tm timeinfo;
+    gmtime_r(&ts, &timeinfo);
+    strftime(out, maxLen, "%Y-%m-%dT%H:%M:%SZ", &timeinfo);
+    return true;
+}
@@ -1,25 +1,145 @@
 #include "ApiClient.h"
 #include "config.h"
+#include "CredentialCodec.h"
 #include <WiFi.h>
 #include <time.h>
 
+#define LOG_MODULE_LEVEL LOG_LEVEL_API
+#include "Log.h"
+
+// ArduinoJson reader over the HTTP stream that pulls the "offline_whitelist"
+// array out as it goes: each item is parsed on its own and added to the
+// index, the main document only sees an empty array. Keeps RAM flat for
+// lists of thousands of entries.
+class WhitelistStreamReader {
+public:
+    WhitelistStreamReader(Stream& stream, OfflineWhitelist& whitelist)
+        : stream(stream), whitelist(whitelist), matched(0), inArray(false), skipped(0) {
+        itemFilter["card_id"] = true;
+        itemFilter["valid_until"] = true;
+    }
+    
+    int read() {
+        if (inArray) {
+            readItems();
+            inArray = false;
+            return ']';
+        }
+        
+        char c;
+        if (stream.readBytes(&c, 1) != 1) {
+            return -1;
+        }
+        track(c);
+        return (uint8_t)c;
+    }
+    
+    size_t readBytes(char* buffer, size_t length) {
+        size_t n = 0;
+        while (n < length) {
+            int c = read();
+            if (c < 0) break;
+            buffer[n++] = (char)c;
+        }
+        return n;
+    }
+    
+    int getSkipped() const { return skipped; }
+    
+private:
+    static constexpr const char* KEY = "\"offline_whitelist\"";
+    
+    Stream& stream;
+    OfflineWhitelist& whitelist;
+    JsonDocument itemFilter;
+    JsonDocument item;
+    size_t matched;         // Chars of KEY seen so far, strlen(KEY) once found
+    bool inArray;
+    int skipped;            // Entries over OFFLINE_WHITELIST_MAX
+    
+    void track(char c) {
+        size_t keyLen = strlen(KEY);
+        if (matched < keyLen) {
+            matched = (c == KEY[matched]) ? matched + 1 : (c == KEY[0] ? 1 : 0);
+            return;
+        }
+        
+        // Key found: the next '[' opens the array (':' and spaces in between)
+        if (c == '[') {
+            inArray = true;
+            matched = 0;
+        } else if (c != ':' && c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+            matched = 0;    // Not an array, leave it to the main parser
+        }
+    }
+    
+    void readItems() {
+        while (true) {
+            char c;
+            if (stream.readBytes(&c, 1) != 1) return;
+            if (c == ']') return;
+            if (c != '{') continue;     // ',' and whitespace between items
+            
+            // Parse from the '{' already consumed: hand it back via a one-char prefix
+            item.clear();
+            PrefixedStream prefixed(stream, '{');
+            if (deserializeJson(item, prefixed, DeserializationOption::Filter(itemFilter))) {
+                return;
+            }
+            
+            const char* cardId = item["card_id"] | "";
+            uint32_t validUntil = item["valid_until"].is<const char*>()
+                ? OfflineWhitelist::parseTime(item["valid_until"].as<const char*>())
+                : (uint32_t)(item["valid_until"] | 0UL);
+            if (!whitelist.add(cardId, strlen(cardId), validUntil)) {
+                skipped++;
+            }
+        }
+    }
+    
+    // Reader that yields one char before the underlying stream
+    struct PrefixedStream {
+        Stream& stream;
+        int prefix;
+        PrefixedStream(Stream& stream, char prefix) : stream(stream), prefix((uint8_t)prefix) {}
+        int read() {
+            if (prefix >= 0) { int c = prefix; prefix = -1; return c; }
+            char c;
+            return stream.readBytes(&c, 1) == 1 ? (uint8_t)c : -1;
+        }
+        size_t readBytes(char* buffer, size_t length) {
+            size_t n = 0;
+            while (n < length) {
+                int c = read();
+                if (c < 0) break;
+                buffer[n++] = (char)c;
+            }
+            return n;
+        }
+    };
+};
+
 ApiClient::ApiClient(const char* baseUrl)
     : baseUrl(baseUrl), consecutiveFailures(0) {
+    tokenLock = xSemaphoreCreateMutex();
     secureClient.setInsecure();
 }
 
 void ApiClient::setDeviceToken(const String& token) {
+    xSemaphoreTake(tokenLock, portMAX_DELAY);
     deviceToken = token;
+    xSemaphoreGive(tokenLock);
 }
 
 void ApiClient::getDeviceToken(String& outToken) const {
+    xSemaphoreTake(tokenLock, portMAX_DELAY);
     outToken = deviceToken;
+    xSemaphoreGive(tokenLock);
 }
 
 void ApiClient::setBaseUrl(const char* newBaseUrl) {
     baseUrl = newBaseUrl;
-    Serial.print("[ApiClient] Base URL updated to: ");
-    Serial.println(baseUrl);
+    LOG_I("ApiClient", "Base URL updated to: %s", baseUrl.c_str());
 }
 
 bool ApiClient::registerDevice(String& outToken) {
@@ -30,6 +150,12 @@ bool ApiClient::registerDevice(String& outToken) {
     requestDoc["firmware_version"] = FIRMWARE_VERSION;
     requestDoc["door_id"] = DOOR_ID;
     
+    // Every door served by this device, door_id above is the first one
+    JsonArray doorIds = requestDoc["door_ids"].to<JsonArray>();
+    for (int i = 0; i < DOOR_COUNT; i++) {
+        doorIds.add(DOOR_PINS[i].doorId);
+    }
+    
     JsonDocument responseDoc;
     if (!post("/device/register", requestDoc, responseDoc)) {
         return false;
@@ -41,13 +167,13 @@ bool ApiClient::registerDevice(String& outToken) {
         return true;
     }
     
-    Serial.println("[API] Missing device_token in response");
+    LOG_E("API", "Missing device_token in response");
     return false;
 }
 
 bool ApiClient::getConfig(DeviceConfig& outConfig) {
     JsonDocument responseDoc;
-    if (!get("/device/config", responseDoc)) {
+    if (!get("/device/config", responseDoc, &outConfig.whitelist)) {
         return false;
     }
     
@@ -57,6 +183,10 @@ bool ApiClient::getConfig(DeviceConfig& outConfig) {
     outConfig.device_id = data["device_id"].as<String>();
     outConfig.relay_open_ms = data["relay_open_ms"] | 3000;
     
+    // Optional remote log level ("info", "debug", ... or 0-5)
+    outConfig.log_level = data.containsKey("log_level") ? Log::parseLevel(data["log_level"].as<String>().c_str()) : -1;
+    outConfig.decision_cache_max_ttl_sec = data["decision_cache_max_ttl_sec"] | -1;
+    
     // Offline mode config
     if (data.containsKey("offline_mode")) {
         outConfig.offline_mode.enabled = data["offline_mode"]["enabled"] | false;
@@ -67,30 +197,35 @@ bool ApiClient::getConfig(DeviceConfig& outConfig) {
     if (data.containsKey("jwt_verification")) {
         outConfig.jwt_verification.alg = data["jwt_verification"]["alg"].as<String>();
         outConfig.jwt_verification.public_key_pem = data["jwt_verification"]["public_key_pem"].as<String>();
-        outConfig.jwt_verification.kid = data["jwt_verification"]["kid"].as<String>();
+        outConfig.jwt_verification.kid = data["jwt_verification"]["kid"] | "";
+        outConfig.jwt_verification.expires_at = 0;
     }
     
-    // Offline whitelist
-    outConfig.whitelist_count = 0;
-    if (data.containsKey("offline_whitelist")) {
-        JsonArray whitelist = data["offline_whitelist"].as<JsonArray>();
-        int count = 0;
-        
-        for (JsonObject item : whitelist) {
-            if (count >= 50) break;  // Max 50 entries
+    // Keys retired by a rotation, kept until their expiry for cards not yet re-issued
+    outConfig.jwt_retired_key_count = 0;
+    if (data["jwt_verification"]["retired_keys"].is<JsonArray>()) {
+        for (JsonObject item : data["jwt_verification"]["retired_keys"].as<JsonArray>()) {
+            if (outConfig.jwt_retired_key_count >= JWT_KEYRING_SIZE - 1) break;
             
-            outConfig.whitelist[count].card_id = item["card_id"].as<String>();
-            outConfig.whitelist[count].user_id = item["user_id"] | "";
-            outConfig.whitelist[count].valid_until = item["valid_until"] | "";
-            count++;
+            // A retired key without a deadline would stay valid forever
+            uint32_t expiresAt = item["expires_at"] | 0;
+            if (expiresAt == 0) {
+                LOG_W("API", "Retired key '%s' has no expires_at, skipped", item["kid"] | "");
+                continue;
+            }
+            
+            JwtVerificationConfig& key = outConfig.jwt_retired_keys[outConfig.jwt_retired_key_count++];
+            key.alg = item["alg"] | "EdDSA";
+            key.public_key_pem = item["public_key_pem"].as<String>();
+            key.kid = item["kid"] | "";
+            key.expires_at = expiresAt;
         }
-        
-        outConfig.whitelist_count = count;
-        Serial.print("[API] Parsed whitelist: ");
-        Serial.print(count);
-        Serial.println(" entries");
     }
     
+    // Offline whitelist was indexed while the response streamed in
+    outConfig.whitelist.finalize();
+    LOG_I("API", "Parsed whitelist: %u entries", (unsigned)outConfig.whitelist.size());
+    
     return true;
 }
 
@@ -102,6 +237,23 @@ bool ApiClient::sendHeartbeat(const DeviceStatus& status) {
     requestDoc["status"]["rssi"] = status.rssi;
     requestDoc["status"]["fw_version"] = status.fw_version;
     
+    // Offline verified-credential cache, to size OFFLINE_VERIFY_CACHE_SIZE
+    if (status.verify_cache_hits + status.verify_cache_misses > 0) {
+        requestDoc["status"]["verify_cache"]["hits"] = status.verify_cache_hits;
+        requestDoc["status"]["verify_cache"]["misses"] = status.verify_cache_misses;
+    }
+    
+    // Lowest free stack of loop(), to size ARDUINO_LOOP_STACK_SIZE
+    requestDoc["status"]["loop_stack_free"] = status.loop_stack_free;
+    
+    // Access logs lost before reaching flash, omitted while there are none
+    if (status.logs_dropped > 0) {
+        requestDoc["status"]["logs_dropped"] = status.logs_dropped;
+    }
+    
+    // Which config the offline decisions run on, bumped by every saved refresh
+    requestDoc["status"]["offline_store_gen"] = status.offline_store_gen;
+    
     // Omit empty last_access_ts
     if (status.last_access_ts.length() > 0) {
         requestDoc["status"]["last_access_ts"] = status.last_access_ts;
@@ -111,7 +263,8 @@ bool ApiClient::sendHeartbeat(const DeviceStatus& status) {
     return post("/device/heartbeat", requestDoc, responseDoc);
 }
 
-bool ApiClient::checkAccess(const AccessCheckRequest& request, AccessCheckResponse& outResponse) {
+bool ApiClient::checkAccess(const AccessCheckRequest& request, AccessCheckResponse& outResponse,
+                            ApiConnection* connection) {
     JsonDocument requestDoc;
     requestDoc["device_id"] = request.device_id;
     requestDoc["door_id"] = request.door_id;
@@ -123,13 +276,26 @@ bool ApiClient::checkAccess(const AccessCheckRequest& request, AccessCheckRespon
     if (request.card_uid.length() > 0) {
         requestDoc["card_uid"] = request.card_uid;
     }
+    CompactCredential compact;
     if (request.credential_raw.length() > 0) {
         requestDoc["credential"]["raw"] = request.credential_raw;
         requestDoc["credential"]["format"] = "jwt";
+    } else if (request.credential_bin_len > 0 &&
+               CredentialCodec::parse(request.credential_bin, request.credential_bin_len, compact)) {
+        // Card holds the compact form, backend expects the canonical JWT
+        requestDoc["credential"]["raw"] = CredentialCodec::toJwt(compact);
+        requestDoc["credential"]["format"] = "jwt";
+    } else if (request.credential_hash_only) {
+        // Credential not read from the card, let the backend compare the hash
+        char hashHex[9];
+        snprintf(hashHex, sizeof(hashHex), "%08lx", (unsigned long)request.credential_hash);
+        requestDoc["credential"]["format"] = "hash";
+        requestDoc["credential"]["hash"] = hashHex;
+        requestDoc["credential"]["length"] = request.credential_len;
     }
     
     JsonDocument responseDoc;
-    if (!post("/access/check", requestDoc, responseDoc)) {
+    if (!post("/access/check", requestDoc, responseDoc, connection)) {
         return false;
     }
     
@@ -139,6 +305,7 @@ bool ApiClient::checkAccess(const AccessCheckRequest& request, AccessCheckRespon
     outResponse.result = data["result"].as<String>();
     outResponse.reason = data["reason"].as<String>();
     outResponse.relay_open_ms = data["relay_open_ms"] | 3000;
+    outResponse.cache_ttl_sec = data["cache_ttl_sec"] | 0;
     
     outResponse.has_user = data.containsKey("user");
     if (outResponse.has_user) {
@@ -184,10 +351,10 @@ bool ApiClient::createCard(const CardCreateRequest& request, CardCreateResponse&
              responseDoc["error"].containsKey("details") && 
              responseDoc["error"]["details"].containsKey("existing_card")) {
         data = responseDoc["error"]["details"]["existing_card"];
-        Serial.println("[API] Card already exists, using existing data");
+        LOG_I("API", "Card already exists, using existing data");
     }
     else {
-        Serial.println("[API] Missing data in card response");
+        LOG_E("API", "Missing data in card response");
         return false;
     }
     
@@ -200,30 +367,25 @@ bool ApiClient::createCard(const CardCreateRequest& request, CardCreateResponse&
     return true;
 }
 
-bool ApiClient::uploadLogs(LogEntry* logs, int count) {
-    JsonDocument requestDoc;
+bool ApiClient::uploadLogs(JsonDocument& requestDoc, bool keepAlive) {
     requestDoc["device_id"] = DEVICE_ID;
     
-    JsonArray logsArray = requestDoc["logs"].to<JsonArray>();
-    for (int i = 0; i < count; i++) {
-        JsonObject logObj = logsArray.add<JsonObject>();
-        logObj["ts"] = logs[i].ts;
-        logObj["door_id"] = logs[i].door_id;
-        logObj["card_id"] = logs[i].card_id;
-        logObj["card_uid"] = logs[i].card_uid;
-        logObj["decision"] = logs[i].decision;
-        logObj["reason"] = logs[i].reason;
-    }
+    // Last batch of a drain asks the server to close, so the TLS session
+    // does not stay allocated while idle
+    http.setReuse(keepAlive);
     
     JsonDocument responseDoc;
-    return post("/access/log-batch", requestDoc, responseDoc);
+    bool ok = post("/access/log-batch", requestDoc, responseDoc);
+    
+    http.setReuse(true);
+    return ok;
 }
 
 bool ApiClient::pollDoorCommand(const String& doorId, DoorCommandPollResponse& outResponse) {
     // Critical: Local clients generally required for thread safety here
     
     if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("[POLL] WiFi not connected");
+        LOG_W("POLL", "WiFi not connected");
         return false;
     }
     
@@ -252,37 +414,33 @@ bool ApiClient::pollDoorCommand(const String& doorId, DoorCommandPollResponse& o
     httpLocal.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
     httpLocal.setRedirectLimit(3);
     
-    if (deviceToken.length() > 0) {
-        httpLocal.addHeader("Authorization", "Bearer " + deviceToken);
+    String token;
+    getDeviceToken(token);
+    if (token.length() > 0) {
+        httpLocal.addHeader("Authorization", "Bearer " + token);
     }
     
-    Serial.println("====================================");
-    Serial.println("[POLL] ⏳ Long polling started... (waiting for command)");
+    LOG_D("POLL", "⏳ Long polling started... (waiting for command)");
     unsigned long startTime = millis();
     
     // This will BLOCK until command arrives or timeout (30s)
     int httpCode = httpLocal.GET();
     
     unsigned long elapsed = millis() - startTime;
-    Serial.print("[POLL] 📨 Response received after ");
-    Serial.print(elapsed);
-    Serial.println("ms");
+    LOG_D("POLL", "📨 Response received after %lums", elapsed);
     
     if (httpCode > 0) {
         if (httpCode == 200) {
             String response = httpLocal.getString();
             
-            Serial.println("[POLL] Response body:");
-            Serial.println(response);
-            Serial.println("====================================\n");
+            LOG_V("POLL", "Response body: %s", response.c_str());
             
             JsonDocument responseDoc;
             DeserializationError error = deserializeJson(responseDoc, response);
             httpLocal.end();
             
             if (error) {
-                Serial.print("[POLL] JSON parse error: ");
-                Serial.println(error.c_str());
+                LOG_E("POLL", "JSON parse error: %s", error.c_str());
                 return false;
             }
             
@@ -299,29 +457,23 @@ bool ApiClient::pollDoorCommand(const String& doorId, DoorCommandPollResponse& o
                 outResponse.command.timestamp = cmdObj["timestamp"].as<String>();
                 outResponse.command.requestedBy = cmdObj["requestedBy"] | "";
                 
-                Serial.print("[POLL] 🚪 Command received: ");
-                Serial.print(outResponse.command.action);
-                Serial.print(" from ");
-                Serial.println(outResponse.command.requestedBy);
+                LOG_I("POLL", "🚪 Command received: %s from %s",
+                      outResponse.command.action.c_str(), outResponse.command.requestedBy.c_str());
             } else {
-                Serial.println("[POLL] ⏱️ No command (timeout)");
+                LOG_D("POLL", "⏱️ No command (timeout)");
             }
             
             // Ignore success/failure for polling (timeouts expected)
             return true;
         } else {
             String errorBody = httpLocal.getString();
-            Serial.print("[POLL] HTTP error ");
-            Serial.println(httpCode);
-            Serial.println(errorBody);
-            Serial.println("====================================\n");
+            LOG_W("POLL", "HTTP error %d", httpCode);
+            LOG_V("POLL", "Error body: %s", errorBody.c_str());
             httpLocal.end();
             return false;
         }
     } else {
-        Serial.print("[POLL] Connection error: ");
-        Serial.println(httpLocal.errorToString(httpCode));
-        Serial.println("====================================\n");
+        LOG_W("POLL", "Connection error: %s", httpLocal.errorToString(httpCode).c_str());
         httpLocal.end();
         return false;
     }
@@ -329,7 +481,7 @@ bool ApiClient::pollDoorCommand(const String& doorId, DoorCommandPollResponse& o
 
 bool ApiClient::acknowledgeDoorCommand(const String& doorId, bool success) {
     if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("[POLL] WiFi not connected");
+        LOG_W("POLL", "WiFi not connected");
         return false;
     }
     
@@ -355,8 +507,10 @@ bool ApiClient::acknowledgeDoorCommand(const String& doorId, bool success) {
     httpLocal.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
     httpLocal.setRedirectLimit(3);
     
-    if (deviceToken.length() > 0) {
-        httpLocal.addHeader("Authorization", "Bearer " + deviceToken);
+    String token;
+    getDeviceToken(token);
+    if (token.length() > 0) {
+        httpLocal.addHeader("Authorization", "Bearer " + token);
     }
     httpLocal.addHeader("Content-Type", "application/json");
     
@@ -371,11 +525,9 @@ bool ApiClient::acknowledgeDoorCommand(const String& doorId, bool success) {
     bool result = (httpCode >= 200 && httpCode < 300);
     
     if (result) {
-        Serial.println("[POLL] ✅ Command acknowledged");
+        LOG_I("POLL", "✅ Command acknowledged");
     } else {
-        Serial.print("[POLL] ❌ Failed to acknowledge command (HTTP ");
-        Serial.print(httpCode);
-        Serial.println(")");
+        LOG_E("POLL", "❌ Failed to acknowledge command (HTTP %d)", httpCode);
     }
     
     httpLocal.end();
@@ -402,7 +554,7 @@ bool ApiClient::checkHealth() {
         static unsigned long lastOfflineLog = 0;
         unsigned long now = millis();
         if (now - lastOfflineLog > 60000) {  // Log once per minute
-            Serial.println("[HEALTH] Already offline, skipping health check");
+            LOG_D("HEALTH", "Already offline, skipping health check");
             lastOfflineLog = now;
         }
         return false;
@@ -429,12 +581,13 @@ bool ApiClient::checkHealth() {
     bool healthy = (httpCode == 200 || httpCode == 404);  // 404 means backend reachable but no /health endpoint
     
     if (healthy) {
-        Serial.println("[HEALTH] API is reachable");
+        LOG_D("HEALTH", "API is reachable");
         recordSuccess();  // Reset failure count
     } else {
         // Log first failure, then every 10th
-        if (consecutiveFailures == 0 || consecutiveFailures % 10 == 0) {
-            Serial.println("[HEALTH] API unreachable");
+        int failures = consecutiveFailures;
+        if (failures == 0 || failures % 10 == 0) {
+            LOG_W("HEALTH", "API unreachable");
         }
         recordFailure();
     }
@@ -476,8 +629,10 @@ bool ApiClient::updateDoorStatus(const String& doorId, bool isOpen, bool isOnlin
     httpLocal.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
     httpLocal.setRedirectLimit(3);
     
-    if (deviceToken.length() > 0) {
-        httpLocal.addHeader("Authorization", "Bearer " + deviceToken);
+    String token;
+    getDeviceToken(token);
+    if (token.length() > 0) {
+        httpLocal.addHeader("Authorization", "Bearer " + token);
     }
     httpLocal.addHeader("Content-Type", "application/json");
     
@@ -500,9 +655,14 @@ bool ApiClient::updateDoorStatus(const String& doorId, bool isOpen, bool isOnlin
     }
 }
 
-bool ApiClient::post(const char* endpoint, const JsonDocument& requestDoc, JsonDocument& responseDoc) {
+bool ApiClient::post(const char* endpoint, const JsonDocument& requestDoc, JsonDocument& responseDoc,
+                     ApiConnection* connection) {
+    // Caller's connection when called outside loop()
+    HTTPClient& http = connection ? connection->http : this->http;
+    WiFiClientSecure& secureClient = connection ? connection->secureClient : this->secureClient;
+    
     if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("[API] WiFi not connected");
+        LOG_W("API", "WiFi not connected");
         recordFailure();
         return false;
     }
@@ -523,26 +683,18 @@ bool ApiClient::post(const char* endpoint, const JsonDocument& requestDoc, JsonD
     
     http.addHeader("Content-Type", "application/json");
     
-    if (deviceToken.length() > 0) {
-        http.addHeader("Authorization", "Bearer " + deviceToken);
+    String token;
+    getDeviceToken(token);
+    if (token.length() > 0) {
+        http.addHeader("Authorization", "Bearer " + token);
     }
     
     String requestBody;
     serializeJson(requestDoc, requestBody);
     
-    Serial.println("====================================");
-    Serial.print("[API_REQ] POST ");
-    Serial.println(endpoint);
-    Serial.print("[API_REQ] URL: ");
-    Serial.println(url);
-    if (deviceToken.length() > 0) {
-        Serial.print("[API_REQ] Auth: Bearer ");
-        Serial.println(deviceToken.substring(0, 20) + "...");
-    }
-    Serial.println("[API_REQ] Body:");
-    serializeJsonPretty(requestDoc, Serial);
-    Serial.println();
-    Serial.println("------------------------------------");
+    LOG_D("API_REQ", "POST %s", endpoint);
+    LOG_V("API_REQ", "URL: %s", url.c_str());
+    LOG_V("API_REQ", "Body: %s", requestBody.c_str());
     
     int httpCode = http.POST(requestBody);
     
@@ -551,45 +703,36 @@ bool ApiClient::post(const char* endpoint, const JsonDocument& requestDoc, JsonD
         if (httpCode == 200 || httpCode == 201 || httpCode == 409) {
             String response = http.getString();
             
-            Serial.print("[API_RES] HTTP ");
-            Serial.println(httpCode);
-            Serial.println("[API_RES] Body:");
-            Serial.println(response);
-            Serial.println("====================================\n");
+            LOG_D("API_RES", "HTTP %d", httpCode);
+            LOG_V("API_RES", "Body: %s", response.c_str());
             
             DeserializationError error = deserializeJson(responseDoc, response);
             http.end();
             
             if (error) {
-                Serial.print("[API_RES] JSON parse error: ");
-                Serial.println(error.c_str());
+                LOG_E("API_RES", "JSON parse error: %s", error.c_str());
                 recordFailure();
                 return false;
             }
             
             // For 409, still return true so caller can extract data from response
             if (httpCode == 409) {
-                Serial.println("[API_RES] Note: Resource already exists (409 Conflict)");
+                LOG_I("API_RES", "Note: Resource already exists (409 Conflict)");
             }
             
             recordSuccess();
             return true;
         } else {
             String errorBody = http.getString();
-            Serial.print("[API_RES] HTTP error ");
-            Serial.println(httpCode);
-            Serial.println("[API_RES] Error body:");
-            Serial.println(errorBody);
-            Serial.println("====================================\n");
+            LOG_W("API_RES", "HTTP error %d", httpCode);
+            LOG_V("API_RES", "Error body: %s", errorBody.c_str());
             http.end();
             secureClient.stop();
             recordFailure();
             return false;
         }
     } else {
-        Serial.print("[API_RES] Connection error: ");
-        Serial.println(http.errorToString(httpCode));
-        Serial.println("====================================\n");
+        LOG_W("API_RES", "Connection error: %s", http.errorToString(httpCode).c_str());
         http.end();
         secureClient.stop();
         recordFailure();
@@ -597,9 +740,9 @@ bool ApiClient::post(const char* endpoint, const JsonDocument& requestDoc, JsonD
     }
 }
 
-bool ApiClient::get(const char* endpoint, JsonDocument& responseDoc) {
+bool ApiClient::get(const char* endpoint, JsonDocument& responseDoc, OfflineWhitelist* whitelist) {
     if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("[API] WiFi not connected");
+        LOG_W("API", "WiFi not connected");
         recordFailure();
         return false;
     }
@@ -618,40 +761,54 @@ bool ApiClient::get(const char* endpoint, JsonDocument& responseDoc) {
     http.setRedirectLimit(3);
     http.setTimeout(API_TIMEOUT_MS);  // Use configured timeout
     
-    if (deviceToken.length() > 0) {
-        http.addHeader("Authorization", "Bearer " + deviceToken);
+    String token;
+    getDeviceToken(token);
+    if (token.length() > 0) {
+        http.addHeader("Authorization", "Bearer " + token);
     }
     
-    Serial.println("====================================");
-    Serial.print("[API_REQ] GET ");
-    Serial.println(endpoint);
-    Serial.print("[API_REQ] URL: ");
-    Serial.println(url);
-    if (deviceToken.length() > 0) {
-        Serial.print("[API_REQ] Auth: Bearer ");
-        Serial.println(deviceToken.substring(0, 20) + "...");
-    }
-    Serial.println("------------------------------------");
+    // Streamed bodies must not be chunk-encoded, HTTP/1.0 rules that out
+    http.useHTTP10(whitelist != nullptr);
+    
+    LOG_D("API_REQ", "GET %s", endpoint);
+    LOG_V("API_REQ", "URL: %s", url.c_str());
     
     int httpCode = http.GET();
     
+    // The flag sticks to the client and also turns reuse off, later POSTs
+    // would go out as HTTP/1.0 on a fresh TLS session each time
+    http.useHTTP10(false);
+    
     if (httpCode > 0) {
         if (httpCode == 200) {
-            String response = http.getString();
-            
-            Serial.print("[API_RES] HTTP ");
-            Serial.println(httpCode);
-            Serial.println("[API_RES] Body:");
-            Serial.println(response);
-            Serial.println("====================================\n");
+            DeserializationError error;
+            LOG_D("API_RES", "HTTP %d", httpCode);
             
-            DeserializationError error = deserializeJson(responseDoc, response);
+            if (whitelist != nullptr) {
+                // Parsed straight off the socket, the body is never held in RAM
+                WhitelistStreamReader reader(http.getStream(), *whitelist);
+                error = deserializeJson(responseDoc, reader);
+                if (whitelist->isOutOfMemory()) {
+                    // A truncated list would deny cards offline until the next refresh
+                    http.end();
+                    secureClient.stop();
+                    LOG_E("API_RES", "Whitelist does not fit in RAM, config not applied");
+                    return false;
+                }
+                if (reader.getSkipped() > 0) {
+                    LOG_W("API_RES", "Whitelist over %d entries, %d dropped",
+                          OFFLINE_WHITELIST_MAX, reader.getSkipped());
+                }
+            } else {
+                String response = http.getString();
+                LOG_V("API_RES", "Body: %s", response.c_str());
+                error = deserializeJson(responseDoc, response);
+            }
             http.end();
             secureClient.stop();
             
             if (error) {
-                Serial.print("[API_RES] JSON parse error: ");
-                Serial.println(error.c_str());
+                LOG_E("API_RES", "JSON parse error: %s", error.c_str());
                 recordFailure();
                 return false;
             }
@@ -660,20 +817,15 @@ bool ApiClient::get(const char* endpoint, JsonDocument& responseDoc) {
             return true;
         } else {
             String errorBody = http.getString();
-            Serial.print("[API_RES] HTTP error ");
-            Serial.println(httpCode);
-            Serial.println("[API_RES] Error body:");
-            Serial.println(errorBody);
-            Serial.println("====================================\n");
+            LOG_W("API_RES", "HTTP error %d", httpCode);
+            LOG_V("API_RES", "Error body: %s", errorBody.c_str());
             http.end();
             secureClient.stop();
             recordFailure();
             return false;
         }
     } else {
-        Serial.print("[API_RES] Connection error: ");
-        Serial.println(http.errorToString(httpCode));
-        Serial.println("====================================\n");
+        LOG_W("API_RES", "Connection error: %s", http.errorToString(httpCode).c_str());
         http.end();
         secureClient.stop();
         recordFailure();
@@ -682,28 +834,26 @@ bool ApiClient::get(const char* endpoint, JsonDocument& responseDoc) {
 }
 
 void ApiClient::recordFailure() {
-    consecutiveFailures++;
+    int failures = ++consecutiveFailures;
     
     // Rate limit failure logs to reduce spam
     static unsigned long lastFailureLog = 0;
     unsigned long now = millis();
     
     // Log first 3 failures, then every 10th, then once per minute after offline
-    bool shouldLog = (consecutiveFailures <= 3) || 
-                     (consecutiveFailures < MAX_API_FAILURES && consecutiveFailures % 5 == 0) ||
-                     (consecutiveFailures >= MAX_API_FAILURES && (now - lastFailureLog > 60000));
+    bool shouldLog = (failures <= 3) || 
+                     (failures < MAX_API_FAILURES && failures % 5 == 0) ||
+                     (failures >= MAX_API_FAILURES && (now - lastFailureLog > 60000));
     
     if (shouldLog) {
-        Serial.print("[API] Consecutive failures: ");
-        Serial.println(consecutiveFailures);
+        LOG_W("API", "Consecutive failures: %d", failures);
         lastFailureLog = now;
     }
 }
 
 void ApiClient::recordSuccess() {
-    if (consecutiveFailures > 0) {
-        Serial.println("[API] Connection restored");
-        consecutiveFailures = 0;
+    if (consecutiveFailures.exchange(0) > 0) {
+        LOG_I("API", "Connection restored");
     }
 }
 
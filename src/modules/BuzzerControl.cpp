@@ -1,8 +1,20 @@
 #include "BuzzerControl.h"
 #include "config.h"
 
+static const BuzzerNote PATTERN_GRANTED[] = {
+    {TONE_ACCESS_GRANTED_1, TONE_DURATION_SHORT},
+    {0, TONE_DURATION_GAP},
+    {TONE_ACCESS_GRANTED_2, TONE_DURATION_SHORT},
+};
+
+static const BuzzerNote PATTERN_DENIED[] = {
+    {TONE_ACCESS_DENIED, TONE_DURATION_MEDIUM},
+};
+
 BuzzerControl::BuzzerControl(uint8_t pin, uint8_t channel)
-    : pin(pin), channel(channel), alarmActive(false) {
+    : pin(pin), channel(channel), alarmActive(false),
+      pattern(NULL), patternLen(0), step(0), stepStartMs(0) {
+    lock = xSemaphoreCreateMutex();
 }
 
 void BuzzerControl::begin() {
@@ -12,29 +24,67 @@ void BuzzerControl::begin() {
     off();
 }
 
-void BuzzerControl::accessGranted() {
-    if (alarmActive) return;
+void BuzzerControl::update() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    
+    if (pattern != NULL && millis() - stepStartMs >= pattern[step].ms) {
+        step++;
+        if (step < patternLen) {
+            stepStartMs = millis();
+            tone(pattern[step].freq);
+        } else {
+            pattern = NULL;
+            off();
+        }
+    }
     
-    toneTimed(TONE_ACCESS_GRANTED_1, TONE_DURATION_SHORT);
-    delay(TONE_DURATION_GAP);
-    toneTimed(TONE_ACCESS_GRANTED_2, TONE_DURATION_SHORT);
+    xSemaphoreGive(lock);
+}
+
+void BuzzerControl::accessGranted() {
+    play(PATTERN_GRANTED, sizeof(PATTERN_GRANTED) / sizeof(PATTERN_GRANTED[0]));
 }
 
 void BuzzerControl::accessDenied() {
-    if (alarmActive) return;
-    toneTimed(TONE_ACCESS_DENIED, TONE_DURATION_MEDIUM);
+    play(PATTERN_DENIED, sizeof(PATTERN_DENIED) / sizeof(PATTERN_DENIED[0]));
+}
+
+void BuzzerControl::play(const BuzzerNote* notes, uint8_t count) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    
+    // A new pattern replaces the one playing
+    if (!alarmActive) {
+        pattern = notes;
+        patternLen = count;
+        step = 0;
+        stepStartMs = millis();
+        tone(notes[0].freq);
+    }
+    
+    xSemaphoreGive(lock);
 }
 
 void BuzzerControl::startAlarm() {
-    if (alarmActive) return;
-    alarmActive = true;
-    tone(TONE_ALARM);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    
+    if (!alarmActive) {
+        alarmActive = true;
+        pattern = NULL;
+        tone(TONE_ALARM);
+    }
+    
+    xSemaphoreGive(lock);
 }
 
 void BuzzerControl::stopAlarm() {
-    if (!alarmActive) return;
-    alarmActive = false;
-    off();
+    xSemaphoreTake(lock, portMAX_DELAY);
+    
+    if (alarmActive) {
+        alarmActive = false;
+        off();
+    }
+    
+    xSemaphoreGive(lock);
 }
 
 bool BuzzerControl::isAlarmActive() const {
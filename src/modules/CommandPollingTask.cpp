@@ -1,26 +1,30 @@
 #include "CommandPollingTask.h"
 
+#define LOG_MODULE_LEVEL LOG_LEVEL_TASKS
+#include "Log.h"
+
 // Static mutex initialization
 SemaphoreHandle_t CommandPollingTask::accessMutex = NULL;
 
 CommandPollingTask::CommandPollingTask(ApiClient& api, AccessController& access, 
-                                       LCDDisplay& lcd, RelayControl& relay)
-    : api(api), access(access), lcd(lcd), relay(relay), taskHandle(NULL), running(false) {
+                                       LCDDisplay& lcd, const DoorChannel& door, uint8_t doorIndex)
+    : api(api), access(access), lcd(lcd), door(door), doorIndex(doorIndex),
+      taskHandle(NULL), running(false) {
     
     // Create mutex if not already created
     if (accessMutex == NULL) {
         accessMutex = xSemaphoreCreateMutex();
         if (accessMutex == NULL) {
-            Serial.println("[POLL_TASK] ERROR: Failed to create mutex!");
+            LOG_E("POLL_TASK", "ERROR: Failed to create mutex!");
         } else {
-            Serial.println("[POLL_TASK] Mutex created successfully");
+            LOG_I("POLL_TASK", "Mutex created successfully");
         }
     }
 }
 
 void CommandPollingTask::begin() {
     if (taskHandle != NULL) {
-        Serial.println("[POLL_TASK] Task already running");
+        LOG_W("POLL_TASK", "Task already running");
         return;
     }
     
@@ -39,9 +43,9 @@ void CommandPollingTask::begin() {
     );
     
     if (result == pdPASS) {
-        Serial.println("[POLL_TASK] ✅ Task created and started on core 1");
+        LOG_I("POLL_TASK", "✅ Task for %s created and started on core 1", door.doorId);
     } else {
-        Serial.println("[POLL_TASK] ❌ Failed to create task!");
+        LOG_E("POLL_TASK", "❌ Failed to create task!");
         running = false;
     }
 }
@@ -60,20 +64,20 @@ void CommandPollingTask::stop() {
     vTaskDelete(taskHandle);
     taskHandle = NULL;
     
-    Serial.println("[POLL_TASK] Task stopped");
+    LOG_I("POLL_TASK", "Task stopped");
 }
 
 // Static task function - FreeRTOS entry point
 void CommandPollingTask::pollingTaskFunction(void* param) {
     CommandPollingTask* instance = static_cast<CommandPollingTask*>(param);
     
-    Serial.println("[POLL_TASK] Polling task running...");
+    LOG_I("POLL_TASK", "Polling task running...");
     
     // Run poll loop
     instance->pollLoop();
     
     // Should never reach here
-    Serial.println("[POLL_TASK] Task exiting (unexpected!)");
+    LOG_E("POLL_TASK", "Task exiting (unexpected!)");
     vTaskDelete(NULL);
 }
 
@@ -88,72 +92,71 @@ void CommandPollingTask::pollLoop() {
         
         if (currentToken.length() == 0) {
             // No token yet, wait and retry
-            Serial.println("[POLL_TASK] ⏸️ No device token, waiting...");
+            LOG_D("POLL_TASK", "⏸️ No device token, waiting...");
             vTaskDelay(pdMS_TO_TICKS(5000));
             continue;
         }
         
         if (api.isOffline()) {
             // API is offline, wait for recovery
-            Serial.println("[POLL_TASK] ⏸️ API offline, waiting...");
+            LOG_D("POLL_TASK", "⏸️ API offline, waiting...");
             vTaskDelay(pdMS_TO_TICKS(10000));
             continue;
         }
         
         // Poll for door command (this will block for up to 30s - that's OK in separate task!)
         DoorCommandPollResponse response;
-        if (api.pollDoorCommand(DOOR_ID, response)) {
+        if (api.pollDoorCommand(door.doorId, response)) {
             if (response.hasCommand) {
                 // Execute the command
                 if (response.command.action == "unlock") {
-                    Serial.println("[POLL_TASK] 🔓 Executing unlock command");
+                    LOG_I("POLL_TASK", "🔓 Executing unlock command (%s)", door.doorId);
                     
                     // CRITICAL: Acquire mutex before modifying shared state
                     if (xSemaphoreTake(accessMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
                         // Grant access - this resets any existing countdown
-                        access.grantAccess("REMOTE_COMMAND");
+                        access.grantAccess("REMOTE_COMMAND", doorIndex);
                         
                         // Release mutex - main loop will handle LCD updates from now on
                         xSemaphoreGive(accessMutex);
                         
                         // Acknowledge command execution
-                        api.acknowledgeDoorCommand(DOOR_ID, true);
+                        api.acknowledgeDoorCommand(door.doorId, true);
                         
                         // Note: No need to restore LCD - AccessController.update() will handle it
                     } else {
-                        Serial.println("[POLL_TASK] ⚠️ Failed to acquire mutex (timeout)");
-                        api.acknowledgeDoorCommand(DOOR_ID, false);
+                        LOG_W("POLL_TASK", "⚠️ Failed to acquire mutex (timeout)");
+                        api.acknowledgeDoorCommand(door.doorId, false);
                     }
-                    
+                
                 } else if (response.command.action == "lock") {
-                    Serial.println("[POLL_TASK] 🔒 Executing lock command");
+                    LOG_I("POLL_TASK", "🔒 Executing lock command (%s)", door.doorId);
                     
                     if (xSemaphoreTake(accessMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
                         // Force lock
-                        relay.lock();
+                        door.relay->lock();
                         
                         // Release mutex - main loop will handle LCD updates and alarm logic
                         xSemaphoreGive(accessMutex);
                         
                         // Acknowledge command execution
-                        api.acknowledgeDoorCommand(DOOR_ID, true);
+                        api.acknowledgeDoorCommand(door.doorId, true);
                         
                         // Note: No need to restore LCD - AccessController.update() will handle it
                     } else {
-                        Serial.println("[POLL_TASK] ⚠️ Failed to acquire mutex (timeout)");
-                        api.acknowledgeDoorCommand(DOOR_ID, false);
+                        LOG_W("POLL_TASK", "⚠️ Failed to acquire mutex (timeout)");
+                        api.acknowledgeDoorCommand(door.doorId, false);
                     }
-                    
+                
                 } else {
-                    Serial.print("[POLL_TASK] ⚠️ Unknown command: ");
-                    Serial.println(response.command.action);
-                    api.acknowledgeDoorCommand(DOOR_ID, false);
+                    LOG_W("POLL_TASK", "⚠️ Unknown command: %s", response.command.action.c_str());
+                    api.acknowledgeDoorCommand(door.doorId, false);
                 }
             }
             // else: timeout (no command) - normal, just continue polling
         } else {
             // Poll failed (network error, etc.)
-            Serial.println("[POLL_TASK] ❌ Poll failed, retrying...");
+            LOG_E("POLL_TASK", "❌ Poll failed, retrying...");
             vTaskDelay(pdMS_TO_TICKS(5000));  // Wait before retry
         }
         
@@ -0,0 +1,267 @@
+#include "CredentialCodec.h"
+#include <ArduinoJson.h>
+
+static const char B64URL_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// Digit value for base64url and standard base64 ('-'/'+' = 62, '_'/'/' = 63),
+// -1 for anything else. One lookup per char instead of range tests
+static const int8_t B64_DECODE[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, 62, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, 63,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+static inline int base64UrlValue(char c) {
+    return B64_DECODE[(uint8_t)c];
+}
+
+static bool isCanonicalSegment(const char* seg, size_t len, size_t decodedLen) {
+    // Length must match and unused bits of the last char must be zero,
+    // otherwise re-encoding would not reproduce the signed bytes
+    if (CredentialCodec::base64UrlEncodedLength(decodedLen) != len) return false;
+    int v = base64UrlValue(seg[len - 1]);
+    if (len % 4 == 2) return (v & 0x0F) == 0;
+    if (len % 4 == 3) return (v & 0x03) == 0;
+    return true;
+}
+
+bool CredentialCodec::isCompact(const uint8_t* data, size_t len) {
+    return len >= CREDENTIAL_COMPACT_FIXED_LEN && data[0] == CREDENTIAL_COMPACT_MAGIC;
+}
+
+size_t CredentialCodec::encode(const String& jwt, uint8_t* out, size_t maxLen) {
+    int firstDot = jwt.indexOf('.');
+    int secondDot = jwt.indexOf('.', firstDot + 1);
+    if (firstDot <= 0 || secondDot <= firstDot + 1) {
+        return 0;
+    }
+    if (maxLen <= CREDENTIAL_COMPACT_FIXED_LEN) {
+        return 0;
+    }
+    
+    const char* token = jwt.c_str();
+    uint8_t* body = out + CREDENTIAL_COMPACT_FIXED_LEN;
+    size_t bodyMax = maxLen - CREDENTIAL_COMPACT_FIXED_LEN;
+    
+    // Signature
+    size_t sigLen = base64UrlDecode(token + secondDot + 1, jwt.length() - secondDot - 1,
+                                    out + 5, CREDENTIAL_SIGNATURE_LEN + 1);
+    if (sigLen != CREDENTIAL_SIGNATURE_LEN) {
+        return 0;
+    }
+    
+    // Header, then payload, decoded straight into place
+    size_t headerLen = base64UrlDecode(token, firstDot, body, bodyMax);
+    if (headerLen == 0 || headerLen > 255 || headerLen >= bodyMax) {
+        return 0;
+    }
+    size_t payloadLen = base64UrlDecode(token + firstDot + 1, secondDot - firstDot - 1,
+                                        body + headerLen, bodyMax - headerLen);
+    if (payloadLen == 0 || payloadLen > 0xFFFF) {
+        return 0;
+    }
+    
+    // Re-encoding must give back the exact token, otherwise the server could
+    // not verify what we rebuild
+    if (!isCanonicalSegment(token, firstDot, headerLen) ||
+        !isCanonicalSegment(token + firstDot + 1, secondDot - firstDot - 1, payloadLen)) {
+        return 0;
+    }
+    
+    out[0] = CREDENTIAL_COMPACT_MAGIC;
+    out[1] = algFromHeader(body, headerLen);
+    out[2] = (uint8_t)headerLen;
+    out[3] = (uint8_t)(payloadLen & 0xFF);
+    out[4] = (uint8_t)((payloadLen >> 8) & 0xFF);
+    
+    return CREDENTIAL_COMPACT_FIXED_LEN + headerLen + payloadLen;
+}
+
+bool CredentialCodec::parse(const uint8_t* data, size_t len, CompactCredential& out) {
+    if (!isCompact(data, len)) {
+        return false;
+    }
+    
+    uint16_t headerLen = data[2];
+    uint16_t payloadLen = data[3] | (data[4] << 8);
+    // Exact length: trailing bytes would give one credential several encodings,
+    // and the verified/decision caches key on the raw bytes
+    if (headerLen == 0 || payloadLen == 0 ||
+        CREDENTIAL_COMPACT_FIXED_LEN + (size_t)headerLen + payloadLen != len) {
+        return false;
+    }
+    
+    out.alg = data[1];
+    out.signature = data + 5;
+    out.header = data + CREDENTIAL_COMPACT_FIXED_LEN;
+    out.headerLen = headerLen;
+    out.payload = out.header + headerLen;
+    out.payloadLen = payloadLen;
+    return true;
+}
+
+size_t CredentialCodec::signingInput(const CompactCredential& cred, char* out, size_t maxLen) {
+    size_t headerChars = base64UrlEncodedLength(cred.headerLen);
+    size_t total = headerChars + 1 + base64UrlEncodedLength(cred.payloadLen);
+    if (total > maxLen) {
+        return 0;
+    }
+    
+    base64UrlEncode(cred.header, cred.headerLen, out);
+    out[headerChars] = '.';
+    base64UrlEncode(cred.payload, cred.payloadLen, out + headerChars + 1);
+    return total;
+}
+
+String CredentialCodec::toJwt(const CompactCredential& cred) {
+    String out;
+    out.reserve(base64UrlEncodedLength(cred.headerLen) + base64UrlEncodedLength(cred.payloadLen) +
+                base64UrlEncodedLength(CREDENTIAL_SIGNATURE_LEN) + 2);
+    appendBase64Url(out, cred.header, cred.headerLen);
+    out += '.';
+    appendBase64Url(out, cred.payload, cred.payloadLen);
+    out += '.';
+    appendBase64Url(out, cred.signature, CREDENTIAL_SIGNATURE_LEN);
+    return out;
+}
+
+size_t CredentialCodec::headerKid(const uint8_t* data, size_t len, char* out, size_t maxLen) {
+    CompactCredential cred;
+    if (parse(data, len, cred)) {
+        return kidFromHeader(cred.header, cred.headerLen, out, maxLen);
+    }
+    
+    // Text JWT: only the first segment needs decoding
+    const char* token = (const char*)data;
+    const char* dot = (const char*)memchr(token, '.', len);
+    if (dot == NULL) {
+        return 0;
+    }
+    
+    uint8_t header[256];
+    size_t headerLen = base64UrlDecode(token, dot - token, header, sizeof(header));
+    return kidFromHeader(header, headerLen, out, maxLen);
+}
+
+uint32_t CredentialCodec::hash(const uint8_t* data, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+size_t CredentialCodec::base64UrlEncodedLength(size_t len) {
+    // Unpadded: 4 chars per 3 bytes, 2 or 3 chars for the tail
+    return (len / 3) * 4 + ((len % 3) ? (len % 3) + 1 : 0);
+}
+
+size_t CredentialCodec::base64UrlEncode(const uint8_t* input, size_t len, char* output) {
+    size_t o = 0;
+    size_t i = 0;
+    
+    for (; i + 3 <= len; i += 3) {
+        uint32_t v = ((uint32_t)input[i] << 16) | ((uint32_t)input[i + 1] << 8) | input[i + 2];
+        output[o++] = B64URL_ALPHABET[(v >> 18) & 0x3F];
+        output[o++] = B64URL_ALPHABET[(v >> 12) & 0x3F];
+        output[o++] = B64URL_ALPHABET[(v >> 6) & 0x3F];
+        output[o++] = B64URL_ALPHABET[v & 0x3F];
+    }
+    
+    size_t rest = len - i;
+    if (rest > 0) {
+        uint32_t v = (uint32_t)input[i] << 16;
+        if (rest == 2) v |= (uint32_t)input[i + 1] << 8;
+        output[o++] = B64URL_ALPHABET[(v >> 18) & 0x3F];
+        output[o++] = B64URL_ALPHABET[(v >> 12) & 0x3F];
+        if (rest == 2) output[o++] = B64URL_ALPHABET[(v >> 6) & 0x3F];
+    }
+    
+    return o;
+}
+
+size_t CredentialCodec::base64UrlDecode(const char* input, size_t len, uint8_t* output, size_t maxLen) {
+    // Accepts base64url and standard base64, padding optional
+    uint32_t value = 0;
+    int bits = 0;
+    size_t decodedLen = 0;
+    
+    for (size_t i = 0; i < len; i++) {
+        char c = input[i];
+        if (c == '=') break;
+        
+        int v = base64UrlValue(c);
+        if (v < 0) continue;  // Skip whitespace/line breaks
+        
+        value = (value << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (decodedLen >= maxLen) return decodedLen;
+            output[decodedLen++] = (uint8_t)((value >> bits) & 0xFF);
+        }
+    }
+    
+    return decodedLen;
+}
+
+uint8_t CredentialCodec::algFromHeader(const uint8_t* header, size_t len) {
+    JsonDocument doc;
+    if (deserializeJson(doc, (const char*)header, len)) {
+        return CREDENTIAL_ALG_UNKNOWN;
+    }
+    
+    return algFromName(doc["alg"] | "");
+}
+
+uint8_t CredentialCodec::algFromName(const char* name) {
+    if (strcmp(name, "EdDSA") == 0) return CREDENTIAL_ALG_EDDSA;
+    if (strcmp(name, "ES256") == 0) return CREDENTIAL_ALG_ES256;
+    return CREDENTIAL_ALG_UNKNOWN;
+}
+
+size_t CredentialCodec::kidFromHeader(const uint8_t* header, size_t len, char* out, size_t maxLen) {
+    JsonDocument filter;
+    filter["kid"] = true;
+    
+    JsonDocument doc;
+    if (len == 0 || deserializeJson(doc, (const char*)header, len, DeserializationOption::Filter(filter))) {
+        return 0;
+    }
+    
+    const char* kid = doc["kid"] | "";
+    size_t kidLen = strlen(kid);
+    if (kidLen >= maxLen) {
+        return 0;
+    }
+    
+    memcpy(out, kid, kidLen + 1);
+    return kidLen;
+}
+
+void CredentialCodec::appendBase64Url(String& out, const uint8_t* data, size_t len) {
+    char chunk[65];
+    
+    // 48 input bytes -> 64 output chars per round
+    while (len > 0) {
+        size_t n = len > 48 ? 48 : len;
+        size_t written = base64UrlEncode(data, n, chunk);
+        out.concat(chunk, written);
+        data += n;
+        len -= n;
+    }
+}
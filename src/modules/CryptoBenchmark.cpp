@@ -0,0 +1,138 @@
+#include "CryptoBenchmark.h"
+#include "CredentialCodec.h"
+#include <Ed25519.h>
+#include <SHA512.h>
+#include <sodium.h>
+#include <esp_system.h>
+#include <mbedtls/ecdsa.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/sha512.h>
+
+#define LOG_MODULE_LEVEL LOG_LEVEL_JWT
+#include "Log.h"
+
+static int fillRandom(void*, unsigned char* out, size_t len) {
+    esp_fill_random(out, len);
+    return 0;
+}
+
+void CryptoBenchmark::run(int iterations) {
+    // Representative card credential: typical header and claims, base64url encoded
+    static const char header[] = "{\"alg\":\"EdDSA\",\"typ\":\"JWT\",\"kid\":\"2025-01\"}";
+    static const char claims[] = "{\"card_id\":\"CARD-000123\",\"card_uid\":\"04A1B2C3D4E5F6\","
+                                 "\"user_id\":\"U-4567\",\"access_level\":\"staff\","
+                                 "\"exp\":1767225600,\"offline_max_until\":1767225600}";
+    
+    CompactCredential cred;
+    cred.header = (const uint8_t*)header;
+    cred.headerLen = sizeof(header) - 1;
+    cred.payload = (const uint8_t*)claims;
+    cred.payloadLen = sizeof(claims) - 1;
+    
+    char message[CREDENTIAL_SIGNING_INPUT_MAX];
+    size_t messageLen = CredentialCodec::signingInput(cred, message, sizeof(message));
+    
+    LOG_I("BENCH", "Verifying %u-byte signing input, %d iterations", (unsigned)messageLen, iterations);
+    
+    uint32_t eddsaHwUs = 0;
+    uint32_t eddsaUs = benchEdDSA((const uint8_t*)message, messageLen, iterations, eddsaHwUs);
+    uint32_t es256Us = benchES256((const uint8_t*)message, messageLen, iterations);
+    
+    LOG_I("BENCH", "EdDSA verify: %lu us avg (software SHA-512)", (unsigned long)eddsaUs);
+    LOG_I("BENCH", "EdDSA verify: %lu us avg (hardware SHA-512, libsodium)", (unsigned long)eddsaHwUs);
+    LOG_I("BENCH", "ES256 verify: %lu us avg (SHA-256 + ECDSA P-256)", (unsigned long)es256Us);
+    
+    benchSHA512((const uint8_t*)message, messageLen, iterations);
+}
+
+uint32_t CryptoBenchmark::benchEdDSA(const uint8_t* message, size_t len, int iterations, uint32_t& hwShaUs) {
+    uint8_t privateKey[32];
+    uint8_t publicKey[32];
+    uint8_t signature[64];
+    
+    esp_fill_random(privateKey, sizeof(privateKey));
+    Ed25519::derivePublicKey(publicKey, privateKey);
+    Ed25519::sign(signature, privateKey, publicKey, message, len);
+    
+    int failures = 0;
+    uint32_t start = micros();
+    for (int i = 0; i < iterations; i++) {
+        if (!Ed25519::verify(signature, publicKey, message, len)) failures++;
+    }
+    uint32_t elapsed = micros() - start;
+    
+    sodium_init();
+    start = micros();
+    for (int i = 0; i < iterations; i++) {
+        if (crypto_sign_ed25519_verify_detached(signature, message, len, publicKey) != 0) failures++;
+    }
+    hwShaUs = (micros() - start) / iterations;
+    
+    if (failures > 0) {
+        LOG_W("BENCH", "EdDSA: %d verify failures", failures);
+    }
+    return elapsed / iterations;
+}
+
+void CryptoBenchmark::benchSHA512(const uint8_t* message, size_t len, int iterations) {
+    // The Ed25519 challenge hash alone: R || A || M is 64 bytes longer than M
+    uint8_t input[CREDENTIAL_SIGNING_INPUT_MAX + 64];
+    uint8_t digest[64];
+    size_t inputLen = len + 64;
+    memset(input, 0xA5, 64);
+    memcpy(input + 64, message, len);
+    
+    SHA512 sha;
+    uint32_t start = micros();
+    for (int i = 0; i < iterations; i++) {
+        sha.reset();
+        sha.update(input, inputLen);
+        sha.finalize(digest, sizeof(digest));
+    }
+    uint32_t softwareUs = (micros() - start) / iterations;
+    
+    start = micros();
+    for (int i = 0; i < iterations; i++) {
+        mbedtls_sha512(input, inputLen, digest, 0);
+    }
+    uint32_t hardwareUs = (micros() - start) / iterations;
+    
+    LOG_I("BENCH", "SHA-512 of %u bytes: %lu us software, %lu us hardware",
+          (unsigned)inputLen, (unsigned long)softwareUs, (unsigned long)hardwareUs);
+}
+
+uint32_t CryptoBenchmark::benchES256(const uint8_t* message, size_t len, int iterations) {
+    mbedtls_ecdsa_context ctx;
+    mbedtls_mpi r, s;
+    mbedtls_ecdsa_init(&ctx);
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&s);
+    
+    uint8_t hash[32];
+    mbedtls_sha256(message, len, hash, 0);
+    
+    uint32_t elapsed = 0;
+    int failures = 0;
+    
+    if (mbedtls_ecdsa_genkey(&ctx, MBEDTLS_ECP_DP_SECP256R1, fillRandom, NULL) != 0 ||
+        mbedtls_ecdsa_sign(&ctx.grp, &r, &s, &ctx.d, hash, sizeof(hash), fillRandom, NULL) != 0) {
+        LOG_W("BENCH", "ES256: key generation/signing failed");
+    } else {
+        // Time what the verifier does per tap: hash the input, then verify
+        uint32_t start = micros();
+        for (int i = 0; i < iterations; i++) {
+            mbedtls_sha256(message, len, hash, 0);
+            if (mbedtls_ecdsa_verify(&ctx.grp, hash, sizeof(hash), &ctx.Q, &r, &s) != 0) failures++;
+        }
+        elapsed = (micros() - start) / iterations;
+    }
+    
+    if (failures > 0) {
+        LOG_W("BENCH", "ES256: %d verify failures", failures);
+    }
+    
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&s);
+    mbedtls_ecdsa_free(&ctx);
+    return elapsed;
+}
@@ -0,0 +1,95 @@
+#include "DecisionCache.h"
+#include <mbedtls/sha256.h>
+
+DecisionCache::DecisionCache()
+    : maxTtlMs(DECISION_CACHE_MAX_TTL_MS) {
+    clear();
+}
+
+void DecisionCache::makeKey(const AccessCheckRequest& request, uint8_t outKey[DECISION_CACHE_KEY_LEN]) {
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    
+    // Terminators keep "ab"+"c" and "a"+"bc" apart
+    mbedtls_sha256_update(&ctx, (const uint8_t*)request.card_id.c_str(), request.card_id.length() + 1);
+    mbedtls_sha256_update(&ctx, (const uint8_t*)request.card_uid.c_str(), request.card_uid.length() + 1);
+    mbedtls_sha256_update(&ctx, (const uint8_t*)request.door_id.c_str(), request.door_id.length() + 1);
+    
+    // Whatever form of the credential the server saw
+    if (request.credential_raw.length() > 0) {
+        mbedtls_sha256_update(&ctx, (const uint8_t*)request.credential_raw.c_str(), request.credential_raw.length());
+    } else if (request.credential_bin_len > 0) {
+        mbedtls_sha256_update(&ctx, request.credential_bin, request.credential_bin_len);
+    } else if (request.credential_hash_only) {
+        mbedtls_sha256_update(&ctx, (const uint8_t*)&request.credential_hash, sizeof(request.credential_hash));
+        mbedtls_sha256_update(&ctx, (const uint8_t*)&request.credential_len, sizeof(request.credential_len));
+    }
+    
+    mbedtls_sha256_finish(&ctx, outKey);
+    mbedtls_sha256_free(&ctx);
+}
+
+bool DecisionCache::lookup(const uint8_t key[DECISION_CACHE_KEY_LEN], bool& allow, String& userName) {
+    uint32_t now = millis();
+    
+    for (int i = 0; i < DECISION_CACHE_SIZE; i++) {
+        const Entry& entry = entries[i];
+        if (isLive(entry, now) && memcmp(entry.key, key, DECISION_CACHE_KEY_LEN) == 0) {
+            allow = entry.allow;
+            userName = entry.userName;
+            return true;
+        }
+    }
+    return false;
+}
+
+void DecisionCache::insert(const uint8_t key[DECISION_CACHE_KEY_LEN], const AccessCheckResponse& response) {
+    uint32_t ttlMs = response.cache_ttl_sec > 0 ? (uint32_t)response.cache_ttl_sec * 1000 : 0;
+    if (ttlMs > maxTtlMs) ttlMs = maxTtlMs;
+    if (ttlMs == 0) return;
+    
+    // Same key, then a free or expired slot, otherwise the one expiring first
+    uint32_t now = millis();
+    int victim = -1;
+    for (int i = 0; i < DECISION_CACHE_SIZE && victim < 0; i++) {
+        if (isLive(entries[i], now) && memcmp(entries[i].key, key, DECISION_CACHE_KEY_LEN) == 0) {
+            victim = i;
+        }
+    }
+    for (int i = 0; i < DECISION_CACHE_SIZE && victim < 0; i++) {
+        if (!isLive(entries[i], now)) {
+            victim = i;
+        }
+    }
+    if (victim < 0) {
+        victim = 0;
+        for (int i = 1; i < DECISION_CACHE_SIZE; i++) {
+            uint32_t left = entries[i].ttlMs - (now - entries[i].storedMs);
+            uint32_t victimLeft = entries[victim].ttlMs - (now - entries[victim].storedMs);
+            if (left < victimLeft) victim = i;
+        }
+    }
+    
+    Entry& entry = entries[victim];
+    memcpy(entry.key, key, DECISION_CACHE_KEY_LEN);
+    entry.allow = response.result == "ALLOW";
+    entry.userName = response.has_user ? response.user.name : "";
+    entry.storedMs = now;
+    entry.ttlMs = ttlMs;
+}
+
+void DecisionCache::clear() {
+    for (int i = 0; i < DECISION_CACHE_SIZE; i++) {
+        entries[i].ttlMs = 0;
+    }
+}
+
+void DecisionCache::setMaxTtl(int maxTtlSec) {
+    maxTtlMs = maxTtlSec < 0 ? DECISION_CACHE_MAX_TTL_MS : (uint32_t)maxTtlSec * 1000;
+    if (maxTtlMs > DECISION_CACHE_MAX_TTL_MS) maxTtlMs = DECISION_CACHE_MAX_TTL_MS;
+}
+
+bool DecisionCache::isLive(const Entry& entry, uint32_t now) {
+    return entry.ttlMs != 0 && now - entry.storedMs < entry.ttlMs;
+}
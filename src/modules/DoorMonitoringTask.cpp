@@ -1,5 +1,8 @@
 #include "DoorMonitoringTask.h"
 
+#define LOG_MODULE_LEVEL LOG_LEVEL_TASKS
+#include "Log.h"
+
 // Reference to global config mode flag from main.cpp
 extern bool inConfigMode;
 
@@ -12,12 +15,12 @@ DoorMonitoringTask::DoorMonitoringTask(ApiClient& api, RelayControl& relay,
       taskHandle(NULL), running(false), lastReportedLockState(false), 
       lockStateChangeTime(0), lastReportTime(0),
       accessGranted(false), unlockTime(0), doorCloseTime(0), 
-      lastDoorOpen(false), alarmTriggered(false) {
+      lastDoorOpen(false), alarmTriggered(false), lastIdleUpdate(0), lastDisplayedSec(-1) {
 }
 
 void DoorMonitoringTask::begin() {
     if (taskHandle != NULL) {
-        Serial.println("[DOOR_MONITOR] Task already running");
+        LOG_W("DOOR_MONITOR", "Task already running");
         return;
     }
     
@@ -35,9 +38,9 @@ void DoorMonitoringTask::begin() {
     );
     
     if (result == pdPASS) {
-        Serial.println("[DOOR_MONITOR] ✅ Task created and started on core 0");
+        LOG_I("DOOR_MONITOR", "✅ Task created and started on core 0");
     } else {
-        Serial.println("[DOOR_MONITOR] ❌ Failed to create task!");
+        LOG_E("DOOR_MONITOR", "❌ Failed to create task!");
         running = false;
     }
 }
@@ -52,7 +55,7 @@ void DoorMonitoringTask::stop() {
     vTaskDelete(taskHandle);
     taskHandle = NULL;
     
-    Serial.println("[DOOR_MONITOR] Task stopped");
+    LOG_I("DOOR_MONITOR", "Task stopped");
 }
 
 void DoorMonitoringTask::notifyAccessGranted() {
@@ -61,13 +64,13 @@ void DoorMonitoringTask::notifyAccessGranted() {
     doorCloseTime = 0;
     alarmTriggered = false;
     relay.unlock();
-    Serial.println("[DOOR_MONITOR] Access granted - door unlocked");
+    LOG_I("DOOR_MONITOR", "Access granted - door unlocked");
 }
 
 void DoorMonitoringTask::notifyAccessRevoked() {
     accessGranted = false;
     relay.lock();
-    Serial.println("[DOOR_MONITOR] Access revoked - door locked");
+    LOG_I("DOOR_MONITOR", "Access revoked - door locked");
 }
 
 bool DoorMonitoringTask::isAccessGranted() const {
@@ -76,7 +79,7 @@ bool DoorMonitoringTask::isAccessGranted() const {
 
 void DoorMonitoringTask::monitoringTaskFunction(void* param) {
     DoorMonitoringTask* instance = static_cast<DoorMonitoringTask*>(param);
-    Serial.println("[DOOR_MONITOR] Monitoring task running...");
+    LOG_I("DOOR_MONITOR", "Monitoring task running...");
     instance->monitorLoop();
     vTaskDelete(NULL);
 }
@@ -97,8 +100,7 @@ void DoorMonitoringTask::monitorLoop() {
         
         // Check for lock state change
         if (currentLockState != lastReportedLockState) {
-            Serial.print("[DOOR_MONITOR] 🔄 Lock state changed: ");
-            Serial.println(currentLockState ? "UNLOCKED" : "LOCKED");
+            LOG_I("DOOR_MONITOR", "🔄 Lock state changed: %s", currentLockState ? "UNLOCKED" : "LOCKED");
             
             lastReportedLockState = currentLockState;
             lockStateChangeTime = now;
@@ -111,7 +113,7 @@ void DoorMonitoringTask::monitorLoop() {
             if (!shouldDefer) {
                 reportStatus();
             } else {
-                Serial.println("[DOOR_MONITOR] Deferring LOCK report until countdown completes");
+                LOG_D("DOOR_MONITOR", "Deferring LOCK report until countdown completes");
             }
         }
         
@@ -137,9 +139,9 @@ void DoorMonitoringTask::checkAlarms() {
     // Track door state changes for logging only
     if (isDoorOpen != lastDoorOpen) {
         if (!isDoorOpen) {
-            Serial.println("[DOOR_MONITOR] Door closed");
+            LOG_I("DOOR_MONITOR", "Door closed");
         } else {
-            Serial.println("[DOOR_MONITOR] Door opened");
+            LOG_I("DOOR_MONITOR", "Door opened");
         }
         lastDoorOpen = isDoorOpen;
     }
@@ -164,8 +166,7 @@ void DoorMonitoringTask::checkAlarms() {
     // Trigger or stop alarm
     if (shouldAlarm) {
         if (!alarmTriggered) {
-            Serial.print("[DOOR_MONITOR] ⚠️ ALARM: ");
-            Serial.println(alarmReason);
+            LOG_W("DOOR_MONITOR", "⚠️ ALARM: %s", alarmReason.c_str());
             buzzer.startAlarm();
             lcd.show("ALARM!", alarmReason.substring(0, 16));
             alarmTriggered = true;
@@ -173,7 +174,7 @@ void DoorMonitoringTask::checkAlarms() {
         // Don't update LCD if alarm is already active - let it show alarm message
     } else {
         if (alarmTriggered || buzzer.isAlarmActive()) {
-            Serial.println("[DOOR_MONITOR] ✓ Stopping alarm - condition cleared");
+            LOG_I("DOOR_MONITOR", "✓ Stopping alarm - condition cleared");
             buzzer.stopAlarm();
             alarmTriggered = false;
             // LCD will be updated by handleRelockLogic in next iteration
@@ -188,7 +189,6 @@ void DoorMonitoringTask::handleRelockLogic() {
     if (!accessGranted) {
         // No active access session, but check if we should show idle state
         // Skip LCD update if in config mode
-        static unsigned long lastIdleUpdate = 0;
         if (!inConfigMode && !isDoorOpen && (now - lastIdleUpdate > 2000)) {
             // Door is closed and no access granted - show idle state
             lcd.show("Locked", "Tap a card");
@@ -204,7 +204,7 @@ void DoorMonitoringTask::handleRelockLogic() {
     
     // Force relock on timeout
     if (now >= (unlockTime + MAX_UNLOCK_DURATION_MS)) {
-        Serial.println("[DOOR_MONITOR] Force relock - timeout");
+        LOG_W("DOOR_MONITOR", "Force relock - timeout");
         relay.lock();
         accessGranted = false;
         lcd.show("Timeout", "Relocked");
@@ -221,13 +221,13 @@ void DoorMonitoringTask::handleRelockLogic() {
         if (doorCloseTime == 0) {
             // Just closed, start countdown
             doorCloseTime = now;
-            Serial.println("[DOOR_MONITOR] Door closed, relocking in 3s");
+            LOG_I("DOOR_MONITOR", "Door closed, relocking in 3s");
             lcd.show("Door closed", "Relock in 3s");
         } else {
             // Check if relock time reached
             unsigned long timeSinceClose = now - doorCloseTime;
             if (timeSinceClose >= RELOCK_DELAY_MS) {
-                Serial.println("[DOOR_MONITOR] Auto relock");
+                LOG_I("DOOR_MONITOR", "Auto relock");
                 relay.lock();
                 accessGranted = false;
                 lcd.show("Locked", "Tap a card");
@@ -236,7 +236,6 @@ void DoorMonitoringTask::handleRelockLogic() {
                 reportStatus();
             } else {
                 // Show countdown - only update when number changes
-                static int lastDisplayedSec = -1;
                 int remainSec = (RELOCK_DELAY_MS - timeSinceClose) / 1000;  // Truncate, not round up
                 
                 // Only update LCD when countdown value actually changes
@@ -256,7 +255,7 @@ bool DoorMonitoringTask::reportStatus() {
         static unsigned long lastSkipLog = 0;
         unsigned long now = millis();
         if (now - lastSkipLog > 60000) {  // Log once per minute
-            Serial.println("[DOOR_MONITOR] Skipping status report - API offline");
+            LOG_D("DOOR_MONITOR", "Skipping status report - API offline");
             lastSkipLog = now;
         }
         return false;
@@ -1,127 +1,184 @@
 #include "JWTVerifier.h"
+#include "CredentialCodec.h"
 #include <Ed25519.h>
 #include <SHA512.h>
+#if JWT_ED25519_HW_SHA
+#include <sodium.h>
+#endif
+#include <mbedtls/sha256.h>
+#include <mbedtls/ecdsa.h>
+
+#define LOG_MODULE_LEVEL LOG_LEVEL_JWT
+#include "Log.h"
 
 JWTVerifier::JWTVerifier() {
+#if JWT_ED25519_HW_SHA
+    sodium_init();
+#endif
+
+    // Only the claims we read are kept when parsing the payload
+    claimsFilter["card_id"] = true;
+    claimsFilter["card_uid"] = true;
+    claimsFilter["user_id"] = true;
+    claimsFilter["access_level"] = true;
+    claimsFilter["exp"] = true;
+    claimsFilter["offline_max_until"] = true;
 }
 
-bool JWTVerifier::verify(const String& jwt, const String& publicKeyPem, JWTPayload& outPayload) {
-    // JWT format: header.payload.signature
-    int firstDot = jwt.indexOf('.');
-    int secondDot = jwt.indexOf('.', firstDot + 1);
+bool JWTVerifier::verify(const String& jwt, const JWTPublicKey& key, JWTPayload& outPayload) {
+    return verify(jwt.c_str(), jwt.length(), key, outPayload);
+}
+
+bool JWTVerifier::verify(const char* token, size_t len, const JWTPublicKey& key, JWTPayload& outPayload) {
+    // JWT format: header.payload.signature, segments are views into the token
+    const char* firstDot = (const char*)memchr(token, '.', len);
+    const char* secondDot = firstDot ? (const char*)memchr(firstDot + 1, '.', token + len - firstDot - 1) : NULL;
     
-    if (firstDot == -1 || secondDot == -1) {
-        Serial.println("[JWT] Invalid JWT format");
+    if (firstDot == NULL || secondDot == NULL) {
+        LOG_W("JWT", "Invalid JWT format");
         return false;
     }
     
-    String header = jwt.substring(0, firstDot);
-    String payload = jwt.substring(firstDot + 1, secondDot);
-    String signature = jwt.substring(secondDot + 1);
+    const char* payload = firstDot + 1;
+    const char* signature = secondDot + 1;
+    size_t payloadChars = secondDot - payload;
+    size_t signatureChars = token + len - signature;
+    
+    // Decode signature (one spare byte so an overlong one is caught)
+    uint8_t signatureBytes[CREDENTIAL_SIGNATURE_LEN + 1];
+    size_t sigLen = CredentialCodec::base64UrlDecode(signature, signatureChars, signatureBytes, sizeof(signatureBytes));
+    if (sigLen != CREDENTIAL_SIGNATURE_LEN) {
+        LOG_W("JWT", "Invalid signature length: %u", (unsigned)sigLen);
+        return false;
+    }
     
-    // Message to verify: header.payload
-    String message = jwt.substring(0, secondDot);
+    // Header alg selects the algorithm (header decoded into the payload buffer, reused below)
+    size_t headerLen = CredentialCodec::base64UrlDecode(token, firstDot - token, payloadBuffer, sizeof(payloadBuffer));
+    uint8_t alg = CredentialCodec::algFromHeader(payloadBuffer, headerLen);
     
-    // Verify signature
-    if (!verifyEdDSASignature(message, signature, publicKeyPem)) {
-        Serial.println("[JWT] Signature verification failed");
+    // Message to verify: header.payload, straight from the token
+    if (!verifySignature(alg, (const uint8_t*)token, secondDot - token, signatureBytes, key)) {
+        LOG_W("JWT", "Signature verification failed");
         return false;
     }
     
     // Decode and parse payload
-    uint8_t payloadBytes[512];
-    int payloadLen = base64UrlDecode(payload, payloadBytes, 512);
+    size_t payloadLen = CredentialCodec::base64UrlDecode(payload, payloadChars, payloadBuffer, sizeof(payloadBuffer));
     if (payloadLen == 0) {
-        Serial.println("[JWT] Failed to decode payload");
+        LOG_W("JWT", "Failed to decode payload");
         return false;
     }
     
-    String payloadJson = String((char*)payloadBytes).substring(0, payloadLen);
-    if (!parsePayload(payloadJson, outPayload)) {
-        Serial.println("[JWT] Failed to parse payload");
+    if (!parsePayload((const char*)payloadBuffer, payloadLen, outPayload)) {
+        LOG_W("JWT", "Failed to parse payload");
         return false;
     }
     
-    Serial.println("[JWT] Verification successful");
+    LOG_D("JWT", "Verification successful");
     return true;
 }
 
-int JWTVerifier::base64UrlDecode(const String& input, uint8_t* output, int maxLen) {
-    // Convert base64url to base64
-    String base64 = input;
-    base64.replace('-', '+');
-    base64.replace('_', '/');
-    
-    // Add padding
-    while (base64.length() % 4 != 0) {
-        base64 += '=';
-    }
-    
-    Serial.print("[JWT] Base64 input length: ");
-    Serial.println(input.length());
-    Serial.print("[JWT] After padding: ");
-    Serial.println(base64.length());
-    
-    const char* b64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    
-    int decodedLen = 0;
-    
-    // Process 4 characters at a time
-    for (size_t i = 0; i < base64.length(); i += 4) {
-        uint32_t value = 0;
-        int validChars = 0;
-        
-        // Decode 4 base64 chars to up to 3 bytes
-        for (int j = 0; j < 4; j++) {
-            if (i + j >= base64.length()) break;
-            
-            char c = base64[i + j];
-            if (c == '=') {
-                break;  // Stop at padding
-            }
-            
-            const char* pos = strchr(b64, c);
-            if (!pos) continue;
-            
-            value = (value << 6) | (pos - b64);
-            validChars++;
-        }
-        
-        // Extract bytes based on valid chars (not padding)
-        if (validChars >= 2) {
-            if (decodedLen < maxLen) output[decodedLen++] = (value >> (validChars * 6 - 8)) & 0xFF;
-        }
-        if (validChars >= 3) {
-            if (decodedLen < maxLen) output[decodedLen++] = (value >> (validChars * 6 - 16)) & 0xFF;
-        }
-        if (validChars >= 4) {
-            if (decodedLen < maxLen) output[decodedLen++] = (value >> (validChars * 6 - 24)) & 0xFF;
-        }
+bool JWTVerifier::verifyCompact(const uint8_t* data, size_t len, const JWTPublicKey& key, JWTPayload& outPayload) {
+    // Compact on-card form: raw signature + header/claims JSON, no base64 to undo
+    CompactCredential cred;
+    if (!CredentialCodec::parse(data, len, cred)) {
+        LOG_W("JWT", "Invalid compact credential");
+        return false;
+    }
+    
+    // Signature covers the JWS signing input, rebuild it from the raw segments
+    size_t messageLen = CredentialCodec::signingInput(cred, messageBuffer, sizeof(messageBuffer));
+    if (messageLen == 0) {
+        LOG_W("JWT", "Signing input too long");
+        return false;
     }
     
-    Serial.print("[JWT] Decoded length: ");
-    Serial.println(decodedLen);
+    if (!verifySignature(cred.alg, (const uint8_t*)messageBuffer, messageLen, cred.signature, key)) {
+        LOG_W("JWT", "Signature verification failed");
+        return false;
+    }
+    
+    if (!parsePayload((const char*)cred.payload, cred.payloadLen, outPayload)) {
+        LOG_W("JWT", "Failed to parse payload");
+        return false;
+    }
     
-    return decodedLen;
+    LOG_D("JWT", "Compact verification successful");
+    return true;
 }
 
-bool JWTVerifier::verifyEdDSASignature(const String& message, const String& signatureB64, const String& publicKeyPem) {
-    // Parse Ed25519 public key from PEM
-    String keyData = publicKeyPem;
-    keyData.replace("-----BEGIN PUBLIC KEY-----", "");
-    keyData.replace("-----END PUBLIC KEY-----", "");
-    keyData.replace("\n", "");
-    keyData.replace("\r", "");
-    keyData.trim();
+bool JWTVerifier::verifyCompactDigest(const uint8_t* data, size_t len, const uint8_t* digest,
+                                      const JWTPublicKey& key, JWTPayload& outPayload) {
+    CompactCredential cred;
+    if (!CredentialCodec::parse(data, len, cred)) {
+        LOG_W("JWT", "Invalid compact credential");
+        return false;
+    }
+    
+    if (!key.valid || cred.alg != CREDENTIAL_ALG_ES256 || key.alg != CREDENTIAL_ALG_ES256) {
+        LOG_W("JWT", "Header alg %u does not match key", cred.alg);
+        return false;
+    }
+    
+    if (!verifyES256Digest(digest, cred.signature, key)) {
+        LOG_W("JWT", "Signature verification failed");
+        return false;
+    }
+    
+    if (!parsePayload((const char*)cred.payload, cred.payloadLen, outPayload)) {
+        LOG_W("JWT", "Failed to parse payload");
+        return false;
+    }
+    
+    LOG_D("JWT", "Streamed verification successful");
+    return true;
+}
+
+bool JWTVerifier::parsePublicKey(const String& publicKeyPem, uint8_t alg, JWTPublicKey& outKey) {
+    outKey.valid = false;
+    outKey.alg = alg;
+    outKey.keyLen = 0;
+    outKey.pk = NULL;
     
     // Decode public key (SPKI format - DER encoded)
     uint8_t decoded[128];
-    int decodedLen = base64UrlDecode(keyData, decoded, 128);
+    size_t decodedLen = decodePem(publicKeyPem, decoded, sizeof(decoded));
     
+    switch (alg) {
+        case CREDENTIAL_ALG_EDDSA:
+            return parseEd25519Key(decoded, decodedLen, outKey);
+        case CREDENTIAL_ALG_ES256:
+            return parseES256Key(decoded, decodedLen, outKey);
+        default:
+            LOG_E("JWT", "Unsupported key alg id: %u", alg);
+            return false;
+    }
+}
+
+void JWTVerifier::freePublicKey(JWTPublicKey& key) {
+    if (key.pk != NULL) {
+        mbedtls_pk_free(key.pk);
+        delete key.pk;
+        key.pk = NULL;
+    }
+    key.valid = false;
+}
+
+size_t JWTVerifier::decodePem(const String& publicKeyPem, uint8_t* out, size_t maxLen) {
+    // Base64 body between the PEM armor lines (decoder skips line breaks)
+    const char* pem = publicKeyPem.c_str();
+    int start = publicKeyPem.indexOf("-----BEGIN PUBLIC KEY-----");
+    start = (start < 0) ? 0 : start + 26;
+    int end = publicKeyPem.indexOf("-----END PUBLIC KEY-----", start);
+    if (end < 0) end = publicKeyPem.length();
+    
+    return CredentialCodec::base64UrlDecode(pem + start, end - start, out, maxLen);
+}
+
+bool JWTVerifier::parseEd25519Key(const uint8_t* decoded, size_t derLen, JWTPublicKey& outKey) {
+    int decodedLen = (int)derLen;
     if (decodedLen < 32) {
-        Serial.print("[JWT] Decoded key too short: ");
-        Serial.print(decodedLen);
-        Serial.println(" bytes");
+        LOG_E("JWT", "Decoded key too short: %d bytes", decodedLen);
         return false;
     }
     
@@ -135,54 +192,123 @@ bool JWTVerifier::verifyEdDSASignature(const String& message, const String& sign
     }
     
     if (keyOffset == -1 || (decodedLen - keyOffset) < 32) {
-        Serial.println("[JWT] Could not find Ed25519 key in SPKI structure");
-        Serial.print("[JWT] Decoded data (");
-        Serial.print(decodedLen);
-        Serial.print(" bytes): ");
-        for (int i = 0; i < min(20, decodedLen); i++) {
-            Serial.print(decoded[i], HEX);
-            Serial.print(" ");
-        }
-        Serial.println("...");
+        LOG_E("JWT", "Could not find Ed25519 key in SPKI structure (%d bytes decoded)", decodedLen);
         return false;
     }
     
-    // Extract 32-byte public key
-    uint8_t publicKey[32];
-    for (int i = 0; i < 32; i++) {
-        publicKey[i] = decoded[keyOffset + i];
+    memcpy(outKey.key, decoded + keyOffset, 32);
+    outKey.keyLen = 32;
+    outKey.valid = true;
+    
+    LOG_D("JWT", "Ed25519 public key parsed");
+    return true;
+}
+
+bool JWTVerifier::parseES256Key(const uint8_t* der, size_t derLen, JWTPublicKey& outKey) {
+    // mbedTLS does the SPKI/curve parsing; the context is kept for every verify
+    mbedtls_pk_context* pk = new mbedtls_pk_context;
+    mbedtls_pk_init(pk);
+    
+    int ret = mbedtls_pk_parse_public_key(pk, der, derLen);
+    if (ret != 0 || mbedtls_pk_get_type(pk) != MBEDTLS_PK_ECKEY ||
+        mbedtls_pk_ec(*pk)->grp.id != MBEDTLS_ECP_DP_SECP256R1) {
+        LOG_E("JWT", "Could not parse P-256 public key (-0x%04x)", (unsigned)-ret);
+        mbedtls_pk_free(pk);
+        delete pk;
+        return false;
     }
     
-    Serial.println("[JWT] Ed25519 public key extracted successfully");
+    // Raw point identifies the key (verified-credential cache)
+    mbedtls_ecp_keypair* ec = mbedtls_pk_ec(*pk);
+    size_t pointLen = 0;
+    mbedtls_ecp_point_write_binary(&ec->grp, &ec->Q, MBEDTLS_ECP_PF_UNCOMPRESSED,
+                                   &pointLen, outKey.key, sizeof(outKey.key));
     
-    // Decode signature
-    uint8_t signatureBytes[64];
-    int sigLen = base64UrlDecode(signatureB64, signatureBytes, 64);
-    if (sigLen != 64) {
-        Serial.print("[JWT] Invalid signature length: ");
-        Serial.println(sigLen);
+    outKey.keyLen = pointLen;
+    outKey.pk = pk;
+    outKey.valid = true;
+    
+    LOG_D("JWT", "P-256 public key parsed");
+    return true;
+}
+
+bool JWTVerifier::verifySignature(uint8_t alg, const uint8_t* message, size_t messageLen,
+                                  const uint8_t signature[64], const JWTPublicKey& key) {
+    if (!key.valid) {
+        LOG_W("JWT", "No public key configured");
         return false;
     }
     
-    // Verify with Ed25519
-    bool valid = Ed25519::verify(signatureBytes, publicKey, (const uint8_t*)message.c_str(), message.length());
+    // Never let the token pick a different algorithm than the key was issued for
+    if (alg != key.alg) {
+        LOG_W("JWT", "Header alg %u does not match key alg %u", alg, key.alg);
+        return false;
+    }
     
+    if (alg == CREDENTIAL_ALG_ES256) {
+        return verifyES256Signature(message, messageLen, signature, key);
+    }
+    return verifyEdDSASignature(message, messageLen, signature, key);
+}
+
+bool JWTVerifier::verifyEdDSASignature(const uint8_t* message, size_t messageLen, const uint8_t signature[64], const JWTPublicKey& key) {
+#if JWT_ED25519_HW_SHA
+    // IDF libsodium hashes R || A || M through mbedTLS, i.e. the SHA accelerator
+    bool valid = crypto_sign_ed25519_verify_detached(signature, message, messageLen, key.key) == 0;
+#else
+    // Software SHA512 inside the Crypto library
+    bool valid = Ed25519::verify(signature, key.key, message, messageLen);
+#endif
+
     if (!valid) {
-        Serial.println("[JWT] Ed25519 verification failed");
+        LOG_D("JWT", "Ed25519 verification failed");
     } else {
-        Serial.println("[JWT] Ed25519 verification SUCCESS!");
+        LOG_D("JWT", "Ed25519 verification SUCCESS!");
     }
     
     return valid;
 }
 
-bool JWTVerifier::parsePayload(const String& payloadJson, JWTPayload& outPayload) {
+bool JWTVerifier::verifyES256Signature(const uint8_t* message, size_t messageLen, const uint8_t signature[64], const JWTPublicKey& key) {
+    // JWS ES256 signature is raw r || s (32 bytes each), not DER
+    uint8_t hash[32];
+    mbedtls_sha256(message, messageLen, hash, 0);
+    
+    if (!verifyES256Digest(hash, signature, key)) {
+        return false;
+    }
+    
+    LOG_D("JWT", "ES256 verification SUCCESS!");
+    return true;
+}
+
+bool JWTVerifier::verifyES256Digest(const uint8_t digest[32], const uint8_t signature[64], const JWTPublicKey& key) {
+    mbedtls_mpi r, s;
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&s);
+    
+    mbedtls_ecp_keypair* ec = mbedtls_pk_ec(*key.pk);
+    int ret = mbedtls_mpi_read_binary(&r, signature, 32);
+    if (ret == 0) ret = mbedtls_mpi_read_binary(&s, signature + 32, 32);
+    if (ret == 0) ret = mbedtls_ecdsa_verify(&ec->grp, digest, 32, &ec->Q, &r, &s);
+    
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&s);
+    
+    if (ret != 0) {
+        LOG_D("JWT", "ES256 verification failed (-0x%04x)", (unsigned)-ret);
+        return false;
+    }
+    return true;
+}
+
+bool JWTVerifier::parsePayload(const char* payloadJson, size_t len, JWTPayload& outPayload) {
     JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, payloadJson);
+    DeserializationError error = deserializeJson(doc, payloadJson, len,
+                                                 DeserializationOption::Filter(claimsFilter));
     
     if (error) {
-        Serial.print("[JWT] JSON parse error: ");
-        Serial.println(error.c_str());
+        LOG_W("JWT", "JSON parse error: %s", error.c_str());
         return false;
     }
     
@@ -196,7 +322,7 @@ bool JWTVerifier::parsePayload(const String& payloadJson, JWTPayload& outPayload
     
     // Validate required fields
     if (outPayload.card_id.length() == 0 || outPayload.exp == 0) {
-        Serial.println("[JWT] Missing required fields");
+        LOG_W("JWT", "Missing required fields");
         outPayload.valid = false;
         return false;
     }
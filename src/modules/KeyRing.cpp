@@ -0,0 +1,126 @@
+#include "KeyRing.h"
+#include "CredentialCodec.h"
+
+#define LOG_MODULE_LEVEL LOG_LEVEL_JWT
+#include "Log.h"
+
+KeyRing::KeyRing() {
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        slots[i].key.pk = NULL;
+    }
+    clear();
+}
+
+KeyRing::~KeyRing() {
+    clear();
+}
+
+void KeyRing::clear() {
+    // ES256 keys own an mbedTLS context
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        JWTVerifier::freePublicKey(slots[i].key);
+        slots[i].used = false;
+    }
+    defaultSlot = -1;
+    count = 0;
+}
+
+bool KeyRing::add(const String& kid, uint8_t alg, const String& publicKeyPem, uint32_t expiresAt, bool isDefault) {
+    if (kid.length() > JWT_KID_MAX_LEN) {
+        LOG_W("KEYS", "kid too long: %s", kid.c_str());
+        return false;
+    }
+    if (!isDefault && expiresAt == 0) {
+        // Only the current key may be open-ended
+        LOG_W("KEYS", "Retired kid '%s' has no expiry, dropped", kid.c_str());
+        return false;
+    }
+    if (count >= JWT_KEYRING_SIZE) {
+        LOG_W("KEYS", "Key ring full, dropping kid '%s'", kid.c_str());
+        return false;
+    }
+    
+    uint32_t kidHash = CredentialCodec::hash((const uint8_t*)kid.c_str(), kid.length());
+    if (findSlot(kid.c_str(), kid.length(), kidHash) >= 0) {
+        LOG_W("KEYS", "Duplicate kid '%s' ignored", kid.c_str());
+        return false;
+    }
+    
+    // First free slot from the hash position
+    int index = kidHash % TABLE_SIZE;
+    while (slots[index].used) {
+        index = (index + 1) % TABLE_SIZE;
+    }
+    
+    Slot& slot = slots[index];
+    if (!JWTVerifier::parsePublicKey(publicKeyPem, alg, slot.key)) {
+        LOG_W("KEYS", "Invalid public key for kid '%s'", kid.c_str());
+        return false;
+    }
+    
+    slot.kidHash = kidHash;
+    memcpy(slot.kid, kid.c_str(), kid.length());
+    slot.kid[kid.length()] = '\0';
+    slot.kidLen = kid.length();
+    slot.expiresAt = expiresAt;
+    slot.used = true;
+    count++;
+    
+    if (isDefault) {
+        defaultSlot = index;
+    }
+    
+    LOG_D("KEYS", "Key '%s' added%s, expires %lu", slot.kid, isDefault ? " (default)" : "",
+          (unsigned long)expiresAt);
+    return true;
+}
+
+const JWTPublicKey* KeyRing::find(const char* kid, size_t kidLen, uint32_t now) const {
+    int index;
+    if (kidLen == 0) {
+        index = defaultSlot;
+    } else {
+        index = findSlot(kid, kidLen, CredentialCodec::hash((const uint8_t*)kid, kidLen));
+        
+        // Config without a kid for the current key: it is the only candidate
+        if (index < 0 && defaultSlot >= 0 && slots[defaultSlot].kidLen == 0) {
+            index = defaultSlot;
+        }
+    }
+    
+    if (index < 0 || !isUsable(slots[index], now)) {
+        return NULL;
+    }
+    return &slots[index].key;
+}
+
+uint32_t KeyRing::clockNow() {
+    time_t now = time(NULL);
+    return now > (time_t)CLOCK_VALID_AFTER ? (uint32_t)now : 0;
+}
+
+int KeyRing::getCount() const {
+    return count;
+}
+
+int KeyRing::findSlot(const char* kid, size_t kidLen, uint32_t kidHash) const {
+    int index = kidHash % TABLE_SIZE;
+    
+    // Table is never full, an empty slot ends the probe
+    for (int probes = 0; probes < TABLE_SIZE && slots[index].used; probes++) {
+        const Slot& slot = slots[index];
+        if (slot.kidHash == kidHash && slot.kidLen == kidLen && memcmp(slot.kid, kid, kidLen) == 0) {
+            return index;
+        }
+        index = (index + 1) % TABLE_SIZE;
+    }
+    return -1;
+}
+
+bool KeyRing::isUsable(const Slot& slot, uint32_t now) const {
+    if (!slot.key.valid) return false;
+    if (slot.expiresAt == 0) return true;
+    
+    // Without a synced clock the retirement deadline cannot be honoured
+    return now != 0 && now < slot.expiresAt;
+}
@@ -0,0 +1,28 @@
+#include "Log.h"
+
+uint8_t Log::level = LOG_RUNTIME_LEVEL;
+
+void Log::setLevel(uint8_t newLevel) {
+    if (newLevel > LOG_LEVEL_VERBOSE) newLevel = LOG_LEVEL_VERBOSE;
+    if (newLevel == level) return;
+    
+    level = newLevel;
+    Serial.printf("[LOG] Runtime level set to %u\n", level);
+}
+
+uint8_t Log::getLevel() {
+    return level;
+}
+
+int Log::parseLevel(const char* name) {
+    if (name == nullptr || name[0] == '\0') return -1;
+    if (name[0] >= '0' && name[0] <= '9') return name[0] - '0';
+    
+    if (strcasecmp(name, "none") == 0) return LOG_LEVEL_NONE;
+    if (strcasecmp(name, "error") == 0) return LOG_LEVEL_ERROR;
+    if (strcasecmp(name, "warn") == 0) return LOG_LEVEL_WARN;
+    if (strcasecmp(name, "info") == 0) return LOG_LEVEL_INFO;
+    if (strcasecmp(name, "debug") == 0) return LOG_LEVEL_DEBUG;
+    if (strcasecmp(name, "verbose") == 0) return LOG_LEVEL_VERBOSE;
+    return -1;
+}
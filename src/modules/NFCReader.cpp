@@ -1,15 +1,103 @@
 #include "NFCReader.h"
 #include "config.h"
+#include "CredentialCodec.h"
 
-NFCReader::NFCReader(uint8_t ssPin, uint8_t rstPin)
-    : mfrc(ssPin, rstPin), ssPin(ssPin), rstPin(rstPin), lastReadTime(0) {
+#define LOG_MODULE_LEVEL LOG_LEVEL_NFC
+#include "Log.h"
+
+static void blockToHex(const byte* data, char* out) {
+    for (int j = 0; j < 16; j++) {
+        snprintf(&out[j * 3], 4, "%02X ", data[j]);
+    }
+}
+
+NFCReader::NFCReader(uint8_t ssPin, uint8_t rstPin, int irqPin)
+    : mfrc(ssPin, rstPin), ssPin(ssPin), rstPin(rstPin), irqPin(irqPin), lastReadTime(0),
+      irqPending(false), irqArmed(false), lastArmTime(0), wakeTask(NULL),
+      authSector(-1), authUs(0), ioUs(0), authCount(0), ioCount(0),
+      credentialImageBlocks(0), headerImageBlocks(0) {
+}
+
+void NFCReader::deselect() {
+    // An RC522 with SS floating low would answer transfers meant for another
+    pinMode(ssPin, OUTPUT);
+    digitalWrite(ssPin, HIGH);
 }
 
 void NFCReader::begin() {
     mfrc.PCD_Init();
     delay(50);
     mfrc.PCD_SetAntennaGain(mfrc.RxGain_max);
-    Serial.println("[NFC] RC522 initialized");
+    
+    if (irqPin >= 0) {
+        pinMode(irqPin, INPUT);
+        
+        // IRQ pin push-pull (DivIEn bit 7), active low, raised on RxIRq only
+        mfrc.PCD_WriteRegister(MFRC522::DivIEnReg, 0x80);
+        mfrc.PCD_WriteRegister(MFRC522::ComIEnReg, 0xA0);
+        mfrc.PCD_WriteRegister(MFRC522::ComIrqReg, 0x7F);
+        
+        // The task that polls the reader gets woken by the ISR
+        wakeTask = xTaskGetCurrentTaskHandle();
+        attachInterruptArg(digitalPinToInterrupt(irqPin), onIrq, this, FALLING);
+        armIrq();
+        LOG_I("NFC", "RC522 initialized (IRQ on GPIO %d)", irqPin);
+        return;
+    }
+    
+    LOG_I("NFC", "RC522 initialized");
+}
+
+void IRAM_ATTR NFCReader::onIrq(void* arg) {
+    NFCReader* reader = static_cast<NFCReader*>(arg);
+    reader->irqPending = true;
+    
+    if (reader->wakeTask != NULL) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(reader->wakeTask, &woken);
+        if (woken) {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+void NFCReader::armIrq() {
+    // Clear anything left over from the last card transaction (releases the
+    // IRQ line), then send a REQA. Only a card in IDLE state answers it, so a
+    // halted card left on the reader does not re-trigger
+    mfrc.PCD_WriteRegister(MFRC522::ComIrqReg, 0x7F);
+    irqPending = false;
+    mfrc.PCD_WriteRegister(MFRC522::FIFODataReg, MFRC522::PICC_CMD_REQA);
+    mfrc.PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Transceive);
+    mfrc.PCD_WriteRegister(MFRC522::BitFramingReg, 0x87);  // StartSend, 7-bit short frame
+    irqArmed = true;
+}
+
+bool NFCReader::pollIrq(uint32_t now) {
+    if (irqArmed && irqPending) {
+        irqArmed = false;
+        mfrc.PCD_WriteRegister(MFRC522::ComIrqReg, 0x7F);
+        irqPending = false;
+        
+        // Card answered our REQA and is READY: anticollision + select
+        if (mfrc.PICC_ReadCardSerial()) {
+            lastReadTime = now;
+            resetAuth();  // New selection, no sector authenticated yet
+            return true;
+        }
+    }
+    
+    // No SPI traffic between REQAs
+    if (!irqArmed || now - lastArmTime >= NFC_IRQ_REARM_MS) {
+        armIrq();
+        lastArmTime = now;
+    }
+    
+    return false;
+}
+
+void NFCReader::setWakeTask(TaskHandle_t task) {
+    wakeTask = task;
 }
 
 bool NFCReader::isCardPresent() {
@@ -19,13 +107,16 @@ bool NFCReader::isCardPresent() {
     callCount++;
     unsigned long now = millis();
     if (now - lastDebug > 5000) {
-        Serial.print("[NFC_DEBUG] is CardPresent called ");
-        Serial.print(callCount);
-        Serial.println(" times in 5s");
+        LOG_V("NFC_DEBUG", "isCardPresent called %d times in 5s", callCount);
         callCount = 0;
         lastDebug = now;
     }
     
+    // IRQ mode: halted cards don't answer REQA, so no cooldown is needed
+    if (irqPin >= 0) {
+        return pollIrq(now);
+    }
+    
     // Cooldown between reads
     if (now - lastReadTime < CARD_READ_COOLDOWN_MS) {
         return false;
@@ -33,6 +124,7 @@ bool NFCReader::isCardPresent() {
     
     if (mfrc.PICC_IsNewCardPresent() && mfrc.PICC_ReadCardSerial()) {
         lastReadTime = now;
+        resetAuth();  // New selection, no sector authenticated yet
         return true;
     }
     
@@ -43,6 +135,7 @@ bool NFCReader::reconnect() {
     // Reset card state
     mfrc.PICC_HaltA();
     mfrc.PCD_StopCrypto1();
+    resetAuth();
     
     // Wake up (WUPA)
     byte bufferATQA[2];
@@ -64,45 +157,109 @@ bool NFCReader::reconnect() {
 }
 
 CardData NFCReader::readCard() {
+    CardData card = readCardHeader();
+    readCredential(card);
+    
+    // Leave card active for potential writes
+    
+    return card;
+}
+
+CardData NFCReader::readCardHeader() {
     CardData card;
     card.has_card_id = false;
     card.has_credential = false;
+    card.has_header = false;
+    card.header_unreadable = false;
+    card.credential_bin_len = 0;
+    card.credential_len = 0;
+    card.credential_hash = 0;
+    card.has_signing_digest = false;
     
     // Read hardware UID
     card.card_uid = uidToString(mfrc.uid);
     
-    // Read card_id (blocks 4-6)
-    String cardId = readNdefText(4, 3);
-    if (cardId.length() > 0) {
-        card.card_id = cardId;
+    // New selection: the credential image is only trusted once readCredential()
+    // fills it again, the card may have been rewritten elsewhere since
+    credentialImageBlocks = 0;
+    credentialImageUid = "";
+    
+    resetPerf();
+    
+    // Read header + card_id (blocks 4-6, one sector)
+    if (readHeaderSector(card) && headerCardId.length() > 0) {
+        card.card_id = headerCardId;
         card.has_card_id = true;
     }
     
+    printPerf("header");
+    
+    return card;
+}
+
+bool NFCReader::readCredential(CardData& card, CredentialSink* sink) {
+    // Header says there is no credential, skip the 30-block region
+    if (card.has_header && card.credential_len == 0) {
+        return false;
+    }
+    
     // Small delay between reads to let card stabilize
     // This helps on first read after power-on when card may not be fully ready
     delay(50);
     
-    // Read credential (30 blocks)
-    String credentialRaw = readNdefText(8, 30);
-    if (credentialRaw.length() > 0) {
+    resetPerf();
+    
+    // Read credential (30 blocks), compact binary or legacy JWT text
+    int credentialLen = readNdefBytes(NFC_CREDENTIAL_START_BLOCK, NFC_CREDENTIAL_BLOCKS,
+                                      card.credential_bin, sizeof(card.credential_bin),
+                                      credentialImage, &credentialImageBlocks, sink);
+    credentialImageUid = card.card_uid;
+    
+    printPerf("read");
+    
+    if (credentialLen <= 0) {
+        return false;
+    }
+    
+    // Header is written last, a mismatch means an interrupted credential write
+    uint32_t hash = CredentialCodec::hash(card.credential_bin, credentialLen);
+    if (card.has_header && (credentialLen != card.credential_len || hash != card.credential_hash)) {
+        LOG_W("NFC", "Credential does not match card header (interrupted write?)");
+        return false;
+    }
+    
+    card.credential_bin_len = credentialLen;
+    card.credential_len = credentialLen;
+    card.credential_hash = hash;
+    
+    CompactCredential compact;
+    if (CredentialCodec::parse(card.credential_bin, credentialLen, compact)) {
+        card.credential.format = "jwt-bin";
+        card.credential.alg = compact.alg == CREDENTIAL_ALG_ES256 ? "ES256" : "EdDSA";
+    } else {
+        String credentialRaw = "";
+        credentialRaw.reserve(credentialLen);
+        for (int i = 0; i < credentialLen && card.credential_bin[i] != 0; i++) {
+            credentialRaw += (char)card.credential_bin[i];
+        }
         card.credential.raw = credentialRaw;
         card.credential.format = "jwt";
-        card.has_credential = true;
     }
+    card.has_credential = true;
     
-    // Leave card active for potential writes
-    
-    return card;
+    return true;
 }
 
 bool NFCReader::writeCardId(const String& cardId) {
-    // Card should still be authenticated from readCard()
+    // Card should still be authenticated from readCardHeader()
     // No need to re-select if user keeps card on reader
     
-    bool success = writeNdefText(4, 3, cardId);
+    // New card_id, credential cleared
+    bool success = writeCardHeader(cardId, 0, 0);
     
     mfrc.PICC_HaltA();
     mfrc.PCD_StopCrypto1();
+    resetAuth();
     
     return success;
 }
@@ -110,15 +267,16 @@ bool NFCReader::writeCardId(const String& cardId) {
 bool NFCReader::clearCardId() {
     // Write empty string to clear card_id
     // This makes the card appear as blank for re-enrollment
-    bool success = writeNdefText(4, 3, "");
+    bool success = writeCardHeader("", 0, 0);
     
     mfrc.PICC_HaltA();
     mfrc.PCD_StopCrypto1();
+    resetAuth();
     
     if (success) {
-        Serial.println("[NFC] Card ID cleared - card is now blank");
+        LOG_I("NFC", "Card ID cleared - card is now blank");
     } else {
-        Serial.println("[NFC] Failed to clear card ID");
+        LOG_E("NFC", "Failed to clear card ID");
     }
     return success;
 }
@@ -126,18 +284,64 @@ bool NFCReader::clearCardId() {
 bool NFCReader::clearCredential() {
     // Clear credential blocks (8-46)
     // Writing empty string will set length to 0
-    bool success = writeNdefText(8, 30, "");
+    bool success = writeNdefText(NFC_CREDENTIAL_START_BLOCK, NFC_CREDENTIAL_BLOCKS, "");
+    
+    // Blocks are zero now (or unknown if the write failed), the image no longer matches
+    credentialImageBlocks = 0;
+    
+    // Keep the header in sync (no-op if it already says "no credential")
+    if (success && headerImageUid == getUID()) {
+        success = writeCardHeader(headerCardId, 0, 0);
+    }
     
     mfrc.PICC_HaltA();
     mfrc.PCD_StopCrypto1();
+    resetAuth();
     
-    Serial.println(success ? "[NFC] Credential cleared" : "[NFC] Failed to clear credential");
+    if (success) {
+        LOG_I("NFC", "Credential cleared");
+    } else {
+        LOG_E("NFC", "Failed to clear credential");
+    }
     return success;
 }
 
 bool NFCReader::writeCredential(const Credential& credential) {
-    // Use 30 blocks (~478 chars)
-    bool success = writeNdefText(8, 30, credential.raw);
+    // The header is rewritten with the new length/hash, so it must be known
+    if (headerImageUid != getUID()) {
+        LOG_E("NFC", "Card header not read, refusing credential write");
+        return false;
+    }
+    
+    // Blocks read by readCredential() for this card let us rewrite only what changed
+    if (credentialImageUid != getUID()) {
+        credentialImageBlocks = 0;
+    }
+    
+    // Store the compact binary form (~25% smaller than the base64url text)
+    uint8_t compact[CREDENTIAL_MAX_BYTES];
+    size_t compactLen = CredentialCodec::encode(credential.raw, compact, sizeof(compact));
+    
+    const uint8_t* data = compact;
+    size_t len = compactLen;
+    if (compactLen > 0) {
+        LOG_D("NFC", "Compact credential: %u bytes (JWT text: %u)",
+              (unsigned)compactLen, (unsigned)credential.raw.length());
+    } else {
+        // Not a compact-encodable JWT, keep it as text (~478 chars max)
+        LOG_W("NFC", "Credential not encodable, writing as text");
+        data = (const uint8_t*)credential.raw.c_str();
+        len = credential.raw.length();
+        if (len > CREDENTIAL_MAX_BYTES) len = CREDENTIAL_MAX_BYTES;
+    }
+    
+    if (!writeNdefBytes(NFC_CREDENTIAL_START_BLOCK, NFC_CREDENTIAL_BLOCKS, data, len,
+                        credentialImage, &credentialImageBlocks)) {
+        return false;
+    }
+    
+    // Header last: it is the commit record for the new credential
+    bool success = writeCardHeader(headerCardId, len, CredentialCodec::hash(data, len));
     
     // Don't halt here - caller will halt after all operations
     // mfrc.PICC_HaltA();
@@ -153,7 +357,8 @@ String NFCReader::getUID() {
 void NFCReader::haltCard() {
     mfrc.PICC_HaltA();
     mfrc.PCD_StopCrypto1();
-    Serial.println("[NFC] Card halted and released");
+    resetAuth();
+    LOG_D("NFC", "Card halted and released");
 }
 
 String NFCReader::uidToString(const MFRC522::Uid& uid) {
@@ -166,57 +371,76 @@ String NFCReader::uidToString(const MFRC522::Uid& uid) {
     return String(buf);
 }
 
-String NFCReader::readNdefText(int startBlock, int numBlocks) {
-    // Read text (skips trailers)
+int NFCReader::readNdefBytes(int startBlock, int numBlocks, uint8_t* out, size_t maxLen,
+                             uint8_t* image, int* imageBlocks, CredentialSink* sink,
+                             const byte* firstBlock) {
+    // Read length-prefixed data (skips trailers)
+    // Length-first: the 2-byte header in the first block tells how many
+    // blocks actually hold data, so only those are read from the card
+    // Returns 0 for a blank or invalid length, -1 when a block read fails.
+    // firstBlock: startBlock already read by the caller, not read again
     
-    Serial.print("[NFC_READ] Starting read at block ");
-    Serial.print(startBlock);
-    Serial.print(", numBlocks=");
-    Serial.println(numBlocks);
+    LOG_V("NFC_READ", "Starting read at block %d, numBlocks=%d", startBlock, numBlocks);
     
     if (numBlocks > 30) numBlocks = 30;  // Safety limit increased
+    if (imageBlocks) *imageBlocks = 0;
     
-    byte blocks[30][18];  // Increased array size
-    byte size = 18;
+    byte buffer[18];  // One block + CRC, data is copied out as blocks arrive
     
-    // Authenticate with default key A
-    MFRC522::MIFARE_Key key;
-    for (byte i = 0; i < 6; i++) key.keyByte[i] = 0xFF;
+    int dataLen = 0;
+    int copied = 0;
+    int blocksNeeded = numBlocks;
     
     // Read blocks, skipping trailer blocks (every 4th block: 7, 11, 15, 19, etc.)
     int blockIdx = 0;
     int currentBlock = startBlock;
     
-    while (blockIdx < numBlocks) {
+    while (blockIdx < blocksNeeded) {
         // Skip trailer blocks (blocks 3, 7, 11, 15, 19, 23, ...)
         if ((currentBlock + 1) % 4 == 0) {
             currentBlock++;
             continue;
         }
         
-        MFRC522::StatusCode status = mfrc.PCD_Authenticate(MFRC522::PICC_CMD_MF_AUTH_KEY_A, currentBlock, &key, &(mfrc.uid));
-        if (status != MFRC522::STATUS_OK) {
-            return "";
+        if (blockIdx == 0 && firstBlock) {
+            memcpy(buffer, firstBlock, 16);
+        } else if (!readBlock(currentBlock, buffer)) {
+            return -1;
+        }
+        
+        // Keep the raw block so later writes can skip unchanged ones
+        if (image) {
+            memcpy(image + blockIdx * 16, buffer, 16);
+            if (imageBlocks) *imageBlocks = blockIdx + 1;
         }
         
-        size = 18;
-        status = mfrc.MIFARE_Read(currentBlock, blocks[blockIdx], &size);
-        if (status != MFRC522::STATUS_OK) {
-            Serial.print("[NFC_READ] Read failed at block ");
-            Serial.println(currentBlock);
-            return "";
+        int startIdx = 0;
+        if (blockIdx == 0) {
+            // Parse: first 2 bytes are length (little endian, supports up to 65535)
+            dataLen = buffer[0] | (buffer[1] << 8);
+            int maxDataLen = numBlocks * 16 - 2;  // -2 for length bytes
+            
+            LOG_V("NFC_READ", "Parsed length: %d bytes (max=%d)", dataLen, maxDataLen);
+            
+            if (dataLen == 0 || dataLen > maxDataLen || dataLen > (int)maxLen) {
+                LOG_D("NFC_READ", "Invalid length, returning empty");
+                return 0;  // Invalid length
+            }
+            
+            blocksNeeded = (dataLen + 2 + 15) / 16;
+            startIdx = 2;  // Skip length bytes in first block
         }
         
-        // Debug: show raw bytes
-        Serial.print("[NFC_READ] Block ");
-        Serial.print(currentBlock);
-        Serial.print(": ");
-        for (int j = 0; j < 16; j++) {
-            if (blocks[blockIdx][j] < 0x10) Serial.print("0");
-            Serial.print(blocks[blockIdx][j], HEX);
-            Serial.print(" ");
+        // Copy this block's payload
+        int blockStart = copied;
+        for (int i = startIdx; i < 16 && copied < dataLen; i++) {
+            out[copied++] = buffer[i];
+        }
+        
+        // Let the consumer work on it while the next block is on the air
+        if (sink) {
+            sink->onCredentialBytes(out + blockStart, copied - blockStart);
         }
-        Serial.println();
         
         blockIdx++;
         currentBlock++;
@@ -225,145 +449,310 @@ String NFCReader::readNdefText(int startBlock, int numBlocks) {
     // Don't stop crypto - keep authentication for potential writes
     // mfrc.PCD_StopCrypto1();
     
-    // Parse: first 2 bytes are length (little endian, supports up to 65535)
-    int textLen = blocks[0][0] | (blocks[0][1] << 8);
-    int maxLen = numBlocks * 16 - 2;  // -2 for length bytes
-    
-    Serial.print("[NFC_READ] Parsed length: ");
-    Serial.print(textLen);
-    Serial.print(" bytes (max=");
-    Serial.print(maxLen);
-    Serial.println(")");
+    LOG_D("NFC_READ", "Read %d bytes from %d/%d blocks", copied, blockIdx, numBlocks);
     
-    if (textLen == 0 || textLen > maxLen) {
-        Serial.println("[NFC_READ] Invalid length, returning empty");
-        return "";  // Invalid length
-    }
-    
-    // Reconstruct text from blocks
-    String text = "";
-    text.reserve(textLen);  // Pre-allocate
-    
-    int read = 0;
-    int byteIdx = 2;  // Start after 2-byte length
-    
-    for (int blk = 0; blk < numBlocks && read < textLen; blk++) {
-        int startIdx = (blk == 0) ? 2 : 0;  // Skip length bytes in first block
-        
-        for (int i = startIdx; i < 16 && read < textLen; i++) {
-            char c = (char)blocks[blk][i];
-            if (c == 0) break;  // Stop at null terminator
-            text += c;
-            read++;
-        }
-    }
-    
-    Serial.print("[NFC_READ] Final text (");
-    Serial.print(text.length());
-    Serial.print(" chars): ");
-    Serial.println(text);
-    
-    return text;
+    return copied;
 }
 
 bool NFCReader::writeNdefText(int startBlock, int numBlocks, const String& text) {
     // Write text (skips trailers)
+    return writeNdefBytes(startBlock, numBlocks, (const uint8_t*)text.c_str(), text.length());
+}
+
+bool NFCReader::writeNdefBytes(int startBlock, int numBlocks, const uint8_t* data, size_t len,
+                               uint8_t* image, int* imageBlocks) {
+    // Write length-prefixed data (skips trailers)
     
-    Serial.print("[NFC_WRITE] Writing to block ");
-    Serial.print(startBlock);
-    Serial.print(", numBlocks=");
-    Serial.print(numBlocks);
-    Serial.print(", len=");
-    Serial.println(text.length());
+    LOG_V("NFC_WRITE", "Writing to block %d, numBlocks=%d, len=%u", startBlock, numBlocks, (unsigned)len);
     
     if (numBlocks > 30) numBlocks = 30;  // Safety limit increased
     
-    int textLen = text.length();
+    int textLen = len;
     int maxLen = numBlocks * 16 - 2;  // -2 for 2-byte length
     if (textLen > maxLen) {
-        Serial.print("[NFC_WRITE] Text truncated from ");
-        Serial.print(textLen);
-        Serial.print(" to ");
-        Serial.println(maxLen);
+        LOG_W("NFC_WRITE", "Data truncated from %d to %d", textLen, maxLen);
         textLen = maxLen;
     }
     
-    // Authenticate with default key A
-    MFRC522::MIFARE_Key key;
-    for (byte i = 0; i < 6; i++) key.keyByte[i] = 0xFF;
-    
     // Prepare data across blocks
     byte blocks[30][16];  // Increased array size
     memset(blocks, 0, sizeof(blocks));
     
-    // First block: [length_low][length_high][text...]
+    // First block: [length_low][length_high][data...]
     blocks[0][0] = (byte)(textLen & 0xFF);  // Low byte
     blocks[0][1] = (byte)((textLen >> 8) & 0xFF);  // High byte
     
     int written = 0;
     // Fill first block (14 bytes available after 2-byte length)
     for (int i = 2; i < 16 && written < textLen; i++) {
-        blocks[0][i] = text[written++];
+        blocks[0][i] = data[written++];
     }
     
     // Fill remaining blocks
     for (int blk = 1; blk < numBlocks; blk++) {
         for (int i = 0; i < 16 && written < textLen; i++) {
-            blocks[blk][i] = text[written++];
+            blocks[blk][i] = data[written++];
         }
     }
     
-    // Write blocks, skipping trailer blocks
-    int blockIdx = 0;
-    int currentBlock = startBlock;
+    // With an image only the blocks holding data are compared/written,
+    // without one the whole region is rewritten so stale data is zeroed
+    int blocksToWrite = image ? (textLen + 2 + 15) / 16 : numBlocks;
     
-    while (blockIdx < numBlocks) {
-        // Skip trailer blocks (blocks 3, 7, 11, 15, 19, 23, ...)
-        if ((currentBlock + 1) % 4 == 0) {
-            currentBlock++;
+    resetPerf();
+    
+    if (!writeBlocks(startBlock, blocks[0], blocksToWrite, image, imageBlocks)) {
+        return false;
+    }
+    
+    LOG_D("NFC_WRITE", "✓ Success: %d bytes at %d", textLen, startBlock);
+    
+    printPerf("write");
+    
+    return true;
+}
+
+bool NFCReader::writeBlocks(int startBlock, byte* blocks, int count, uint8_t* image, int* imageBlocks) {
+    // Write only blocks that differ from the known image (if any)
+    int knownBlocks = (image && imageBlocks) ? *imageBlocks : 0;
+    int writtenBlocks = 0;
+    int skippedBlocks = 0;
+    
+    // Data blocks first, block 0 (length/header) last: an interrupted write
+    // keeps the old length over partly new data and fails verification
+    for (int i = 1; i <= count; i++) {
+        int blockIdx = (i == count) ? 0 : i;
+        byte* data = blocks + blockIdx * 16;
+        
+        if (blockIdx < knownBlocks && memcmp(image + blockIdx * 16, data, 16) == 0) {
+            skippedBlocks++;
             continue;
         }
         
-        MFRC522::StatusCode status = mfrc.PCD_Authenticate(MFRC522::PICC_CMD_MF_AUTH_KEY_A, currentBlock, &key, &(mfrc.uid));
-        if (status != MFRC522::STATUS_OK) {
-            Serial.print("[NFC] Auth failed block ");
-            Serial.print(currentBlock);
-            Serial.print(": ");
-            Serial.println(mfrc.GetStatusCodeName(status));
+        if (!writeBlock(dataBlockAddress(startBlock, blockIdx), data)) {
+            if (imageBlocks) *imageBlocks = 0;  // Card content unknown now
             return false;
         }
-        
-        status = mfrc.MIFARE_Write(currentBlock, blocks[blockIdx], 16);
-        if (status != MFRC522::STATUS_OK) {
-            Serial.print("[NFC_WRITE] Write failed block ");
-            Serial.print(currentBlock);
-            Serial.print(": ");
-            Serial.println(mfrc.GetStatusCodeName(status));
+        writtenBlocks++;
+    }
+    
+    // Keep the image in sync for later writes in the same session
+    if (image && imageBlocks) {
+        memcpy(image, blocks, count * 16);
+        if (*imageBlocks < count) *imageBlocks = count;
+    }
+    
+    LOG_D("NFC_WRITE", "%d blocks written, %d unchanged", writtenBlocks, skippedBlocks);
+    
+    return true;
+}
+
+bool NFCReader::readBlock(int block, byte* buffer) {
+    // Only re-authenticate when crossing into a new sector
+    if (!authenticateBlock(block)) {
+        return false;
+    }
+    
+    byte size = 18;
+    uint32_t ioStartUs = micros();
+    MFRC522::StatusCode status = mfrc.MIFARE_Read(block, buffer, &size);
+    ioUs += micros() - ioStartUs;
+    ioCount++;
+    if (status != MFRC522::STATUS_OK) {
+        LOG_E("NFC_READ", "Read failed at block %d", block);
+        resetAuth();
+        return false;
+    }
+    
+    // Debug: show raw bytes
+    if (LOG_ENABLED(LOG_LEVEL_VERBOSE)) {
+        char hex[16 * 3 + 1];
+        blockToHex(buffer, hex);
+        LOG_V("NFC_READ", "Block %d: %s", block, hex);
+    }
+    
+    return true;
+}
+
+bool NFCReader::readHeaderSector(CardData& card) {
+    headerImageBlocks = 0;
+    headerImageUid = card.card_uid;
+    headerCardId = "";
+    
+    // Any failure from here on marks the header unreadable: the caller must
+    // not mistake a card it cannot parse for a blank one and overwrite it
+    byte buffer[18];
+    if (!readBlock(NFC_HEADER_BLOCK, buffer)) {
+        card.header_unreadable = true;
+        return false;
+    }
+    memcpy(headerImage, buffer, 16);
+    
+    if (buffer[0] != NFC_CARD_HEADER_MAGIC) {
+        // Legacy layout: length-prefixed card_id text, no header.
+        // Image stays empty so the first header write rewrites the sector
+        uint8_t text[NFC_CARD_ID_BLOCKS * 16];
+        int len = readNdefBytes(NFC_CARD_ID_START_BLOCK, NFC_CARD_ID_BLOCKS, text, sizeof(text),
+                                nullptr, nullptr, nullptr, buffer);
+        if (len < 0) {
+            // card_id spans blocks 5-6 and one of them failed: not a blank card
+            card.header_unreadable = true;
             return false;
         }
-        
-        // Debug: show what was written
-        Serial.print("[NFC_WRITE] Block ");
-        Serial.print(currentBlock);
-        Serial.print(": ");
-        for (int j = 0; j < 16; j++) {
-            if (blocks[blockIdx][j] < 0x10) Serial.print("0");
-            Serial.print(blocks[blockIdx][j], HEX);
-            Serial.print(" ");
+        headerCardId.reserve(len);
+        for (int i = 0; i < len && text[i] != 0; i++) {
+            headerCardId += (char)text[i];
         }
-        Serial.println();
-        
-        blockIdx++;
-        currentBlock++;
+        return true;
     }
+    headerImageBlocks = 1;
     
-    Serial.print("[NFC_WRITE] ✓ Success: ");
-    Serial.print(numBlocks);
-    Serial.print(" blocks at ");
-    Serial.print(startBlock);
-    Serial.print(", ");
-    Serial.print(textLen);
-    Serial.println(" chars written");
+    int cardIdLen = buffer[2];
+    if (buffer[1] != NFC_CARD_LAYOUT_VERSION || cardIdLen > NFC_CARD_ID_MAX_LEN) {
+        LOG_W("NFC", "Unsupported card header, version %u", buffer[1]);
+        card.header_unreadable = true;
+        return false;
+    }
+    
+    card.has_header = true;
+    card.credential_len = buffer[4] | (buffer[5] << 8);
+    card.credential_hash = (uint32_t)buffer[6] | ((uint32_t)buffer[7] << 8) |
+                           ((uint32_t)buffer[8] << 16) | ((uint32_t)buffer[9] << 24);
+    
+    // Rest of card_id lives in blocks 5-6, read only if needed
+    int blocksNeeded = (NFC_CARD_HEADER_LEN + cardIdLen + 15) / 16;
+    for (int i = 1; i < blocksNeeded; i++) {
+        if (!readBlock(NFC_HEADER_BLOCK + i, buffer)) {
+            card.has_header = false;
+            card.header_unreadable = true;
+            return false;
+        }
+        memcpy(headerImage + i * 16, buffer, 16);
+        headerImageBlocks = i + 1;
+    }
+    
+    headerCardId.reserve(cardIdLen);
+    for (int i = 0; i < cardIdLen; i++) {
+        headerCardId += (char)headerImage[NFC_CARD_HEADER_LEN + i];
+    }
+    
+    LOG_D("NFC", "Header v%u, credential %u bytes", headerImage[1], card.credential_len);
+    
+    return true;
+}
+
+bool NFCReader::writeCardHeader(const String& cardId, uint16_t credentialLen, uint32_t credentialHash) {
+    // Header + card_id share blocks 4-6:
+    // [magic][version][card_id len][reserved][cred len x2][cred hash x4][card_id...]
+    int cardIdLen = cardId.length();
+    if (cardIdLen > NFC_CARD_ID_MAX_LEN) {
+        LOG_E("NFC_WRITE", "card_id too long: %d", cardIdLen);
+        return false;
+    }
+    
+    byte blocks[NFC_CARD_ID_BLOCKS][16];
+    memset(blocks, 0, sizeof(blocks));
+    byte* header = blocks[0];
+    header[0] = NFC_CARD_HEADER_MAGIC;
+    header[1] = NFC_CARD_LAYOUT_VERSION;
+    header[2] = (byte)cardIdLen;
+    header[4] = (byte)(credentialLen & 0xFF);
+    header[5] = (byte)((credentialLen >> 8) & 0xFF);
+    header[6] = (byte)(credentialHash & 0xFF);
+    header[7] = (byte)((credentialHash >> 8) & 0xFF);
+    header[8] = (byte)((credentialHash >> 16) & 0xFF);
+    header[9] = (byte)((credentialHash >> 24) & 0xFF);
+    memcpy(header + NFC_CARD_HEADER_LEN, cardId.c_str(), cardIdLen);
+    
+    // Delta only against what was read from this same card
+    if (headerImageUid != getUID()) {
+        headerImageBlocks = 0;
+        headerImageUid = getUID();
+    }
+    
+    int blocksToWrite = (NFC_CARD_HEADER_LEN + cardIdLen + 15) / 16;
+    if (!writeBlocks(NFC_HEADER_BLOCK, blocks[0], blocksToWrite, headerImage, &headerImageBlocks)) {
+        return false;
+    }
+    
+    headerCardId = cardId;
+    return true;
+}
+
+bool NFCReader::writeBlock(int block, byte* data) {
+    // Only re-authenticate when crossing into a new sector
+    if (!authenticateBlock(block)) {
+        return false;
+    }
+    
+    uint32_t ioStartUs = micros();
+    MFRC522::StatusCode status = mfrc.MIFARE_Write(block, data, 16);
+    ioUs += micros() - ioStartUs;
+    ioCount++;
+    if (status != MFRC522::STATUS_OK) {
+        LOG_E("NFC_WRITE", "Write failed block %d: %s", block, (const char*)mfrc.GetStatusCodeName(status));
+        resetAuth();
+        return false;
+    }
+    
+    // Debug: show what was written
+    if (LOG_ENABLED(LOG_LEVEL_VERBOSE)) {
+        char hex[16 * 3 + 1];
+        blockToHex(data, hex);
+        LOG_V("NFC_WRITE", "Block %d: %s", block, hex);
+    }
     
     return true;
 }
+
+int NFCReader::dataBlockAddress(int startBlock, int index) {
+    // Map data block index to block address, skipping trailers (3, 7, 11, ...)
+    int block = startBlock;
+    for (int i = 0; ; block++) {
+        if ((block + 1) % 4 == 0) continue;
+        if (i == index) return block;
+        i++;
+    }
+}
+
+bool NFCReader::authenticateBlock(int block) {
+    // MIFARE Classic 1K: 4 blocks per sector, one Crypto1 session covers the whole sector
+    int sector = block / 4;
+    if (sector == authSector) {
+        return true;
+    }
+    
+    // Authenticate with default key A
+    MFRC522::MIFARE_Key key;
+    for (byte i = 0; i < 6; i++) key.keyByte[i] = 0xFF;
+    
+    uint32_t authStartUs = micros();
+    MFRC522::StatusCode status = mfrc.PCD_Authenticate(MFRC522::PICC_CMD_MF_AUTH_KEY_A, block, &key, &(mfrc.uid));
+    authUs += micros() - authStartUs;
+    authCount++;
+    
+    if (status != MFRC522::STATUS_OK) {
+        LOG_E("NFC", "Auth failed block %d: %s", block, (const char*)mfrc.GetStatusCodeName(status));
+        resetAuth();
+        return false;
+    }
+    
+    authSector = sector;
+    return true;
+}
+
+void NFCReader::resetAuth() {
+    authSector = -1;
+}
+
+void NFCReader::resetPerf() {
+    authUs = 0;
+    ioUs = 0;
+    authCount = 0;
+    ioCount = 0;
+}
+
+void NFCReader::printPerf(const char* op) {
+    LOG_D("PERF", "NFC %s | auth: %lums (%ux) | %s: %lums (%u blocks)",
+          op, (unsigned long)(authUs / 1000), authCount, op, (unsigned long)(ioUs / 1000), ioCount);
+}
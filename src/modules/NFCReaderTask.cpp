@@ -0,0 +1,181 @@
+#include "NFCReaderTask.h"
+#include <new>
+
+#define LOG_MODULE_LEVEL LOG_LEVEL_TASKS
+#include "Log.h"
+
+// Reference to global config mode flag from main.cpp
+extern bool inConfigMode;
+
+NFCReaderTask::NFCReaderTask(NFCReader* const* readers, uint8_t count, ApiClient& api)
+    : readers(readers), readerCount(count), api(api), taskHandle(NULL), cardQueue(NULL),
+      nextReader(0), running(false) {
+    for (int i = 0; i < DOOR_COUNT; i++) {
+        handedOver[i] = false;
+    }
+}
+
+void NFCReaderTask::begin() {
+    if (taskHandle != NULL) {
+        LOG_W("NFC_TASK", "Task already running");
+        return;
+    }
+    
+    // At most one card in flight per reader, the reader is handed over with it
+    cardQueue = xQueueCreate(readerCount, sizeof(CardData*));
+    if (cardQueue == NULL) {
+        LOG_E("NFC_TASK", "❌ Failed to create queue!");
+        return;
+    }
+    
+    running = true;
+    
+    // Core 1 next to loop(), higher priority so taps preempt it
+    BaseType_t result = xTaskCreatePinnedToCore(
+        readerTaskFunction,
+        "NFCReader",
+        NFC_TASK_STACK_SIZE,
+        this,
+        NFC_TASK_PRIORITY,
+        &taskHandle,
+        1  // Core 1
+    );
+    
+    if (result == pdPASS) {
+        LOG_I("NFC_TASK", "✅ Task created and started on core 1");
+    } else {
+        LOG_E("NFC_TASK", "❌ Failed to create task!");
+        running = false;
+    }
+}
+
+void NFCReaderTask::stop() {
+    if (taskHandle == NULL) {
+        return;
+    }
+    
+    running = false;
+    vTaskDelay(pdMS_TO_TICKS(100));
+    vTaskDelete(taskHandle);
+    taskHandle = NULL;
+    
+    LOG_I("NFC_TASK", "Task stopped");
+}
+
+CardData* NFCReaderTask::receiveCard(uint32_t timeoutMs) {
+    if (cardQueue == NULL) {
+        return NULL;
+    }
+    
+    CardData* card = NULL;
+    if (xQueueReceive(cardQueue, &card, pdMS_TO_TICKS(timeoutMs)) != pdTRUE) {
+        return NULL;
+    }
+    return card;
+}
+
+bool NFCReaderTask::waitForCard(uint32_t timeoutMs) {
+    if (cardQueue == NULL) {
+        delay(timeoutMs);
+        return false;
+    }
+    
+    CardData* card = NULL;
+    return xQueuePeek(cardQueue, &card, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}
+
+void NFCReaderTask::releaseReader(uint8_t door) {
+    if (door >= readerCount) {
+        return;
+    }
+    
+    handedOver[door] = false;
+    
+    // Poll it again right away instead of after the idle sleep
+    if (taskHandle != NULL) {
+        xTaskNotifyGive(taskHandle);
+    }
+}
+
+void NFCReaderTask::readerTaskFunction(void* param) {
+    NFCReaderTask* instance = static_cast<NFCReaderTask*>(param);
+    LOG_I("NFC_TASK", "Reader task running...");
+    instance->readerLoop();
+    vTaskDelete(NULL);
+}
+
+void NFCReaderTask::readerLoop() {
+    // Card IRQs of every reader wake this task
+    for (uint8_t i = 0; i < readerCount; i++) {
+        readers[i]->setWakeTask(xTaskGetCurrentTaskHandle());
+    }
+    
+    while (running) {
+        if (inConfigMode) {
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+        
+        bool found = false;
+        for (uint8_t n = 0; n < readerCount && !found; n++) {
+            uint8_t door = (nextReader + n) % readerCount;
+            if (handedOver[door] || !readers[door]->isCardPresent()) {
+                continue;
+            }
+            found = true;
+            
+            CardData* card = readCard(door);
+            if (card == NULL) {
+                LOG_E("NFC_TASK", "Out of memory for card event");
+                readers[door]->haltCard();
+                continue;
+            }
+            
+            // Hand the card and the reader over, the consumer releases it when done.
+            // One queue slot per reader, so this never waits
+            handedOver[door] = true;
+            nextReader = (door + 1) % readerCount;
+            xQueueSend(cardQueue, &card, portMAX_DELAY);
+        }
+        
+        if (!found) {
+            // Returns early on a card IRQ or a released reader
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NFC_TASK_IDLE_MS));
+        }
+    }
+}
+
+CardData* NFCReaderTask::readCard(uint8_t door) {
+    uint32_t detectedMs = millis();
+    NFCReader& nfc = *readers[door];
+    
+    CardData* card = new (std::nothrow) CardData();
+    if (card == NULL) {
+        return NULL;
+    }
+    
+    // Header sector first, it tells whether the 30-block credential is needed
+    *card = nfc.readCardHeader();
+    card->detected_ms = detectedMs;
+    card->door = door;
+    
+    // Blank cards are enrolled without a credential read. Online taps can
+    // send the header hash instead when the backend supports it
+    bool offline = api.isOffline();
+    bool hashOnly = CARD_SEND_CREDENTIAL_HASH && card->has_header && !offline;
+    if (card->has_card_id && !hashOnly) {
+        if (offline) {
+            // Offline verification follows: hash the signing input as blocks arrive
+            streamingVerifier.begin();
+            nfc.readCredential(*card, &streamingVerifier);
+            streamingVerifier.finish(*card);
+        } else {
+            nfc.readCredential(*card);
+        }
+    }
+    
+    LOG_D("PERF", "Card UID: %s | door %u | NFC read: %lums",
+          card->card_uid.c_str(), door, (unsigned long)(millis() - detectedMs));
+    
+    return card;
+}
@@ -0,0 +1,267 @@
+#include "OfflineStore.h"
+#include <esp_rom_crc.h>
+
+#define LOG_MODULE_LEVEL LOG_LEVEL_ACCESS
+#include "Log.h"
+
+#define OFFLINE_STORE_MAGIC 0x4C57464FUL    // "OFWL"
+#define OFFLINE_STORE_VERSION 1
+#define OFFLINE_STORE_BODY_OFFSET 64
+#define OFFLINE_STORE_KEYS_MAX 2048
+#define FLASH_SECTOR_SIZE 4096
+
+OfflineStore::OfflineStore()
+    : partition(NULL), mapHandle(0), mapped(NULL), activeSlot(-1) {
+    memset(&header, 0, sizeof(header));
+}
+
+OfflineStore::~OfflineStore() {
+    unmap();
+}
+
+bool OfflineStore::begin() {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                         (esp_partition_subtype_t)OFFLINE_STORE_SUBTYPE,
+                                         OFFLINE_STORE_PARTITION);
+    if (partition == NULL || partition->size < 2 * OFFLINE_STORE_SLOT_SIZE) {
+        LOG_E("STORE", "No \"%s\" partition (check partitions.csv)", OFFLINE_STORE_PARTITION);
+        partition = NULL;
+        return false;
+    }
+    
+    // Newest slot whose header and body both check out
+    Header slots[2];
+    bool valid[2];
+    for (int i = 0; i < 2; i++) {
+        valid[i] = readHeader(i, slots[i]);
+    }
+    
+    int best = -1;
+    if (valid[0] && valid[1]) {
+        best = (int32_t)(slots[1].generation - slots[0].generation) > 0 ? 1 : 0;
+    } else if (valid[0] || valid[1]) {
+        best = valid[0] ? 0 : 1;
+    }
+    
+    // Body CRC needs the mapping; fall back to the other slot if it fails
+    if (best >= 0 && !mapSlot(best, slots[best])) {
+        best = valid[1 - best] && mapSlot(1 - best, slots[1 - best]) ? 1 - best : -1;
+    }
+    
+    if (best < 0) {
+        LOG_I("STORE", "No stored offline data");
+        return false;
+    }
+    
+    LOG_I("STORE", "Offline data gen %lu: %lu whitelist entries, %u keys (slot %d)",
+          (unsigned long)header.generation, (unsigned long)header.entryCount,
+          header.keyCount, activeSlot);
+    return true;
+}
+
+uint32_t OfflineStore::getGeneration() const {
+    return header.generation;
+}
+
+const void* OfflineStore::getEntries() const {
+    return mapped ? mapped + OFFLINE_STORE_BODY_OFFSET : NULL;
+}
+
+size_t OfflineStore::getEntryCount() const {
+    return mapped ? header.entryCount : 0;
+}
+
+int OfflineStore::loadKeys(JwtVerificationConfig* out, int maxKeys) const {
+    if (mapped == NULL) return 0;
+    
+    const uint8_t* p = mapped + header.keysOffset;
+    const uint8_t* end = p + header.keysLength;
+    int count = 0;
+    
+    while (count < header.keyCount && count < maxKeys && p < end) {
+        JwtVerificationConfig& key = out[count];
+        
+        uint8_t kidLen = *p++;
+        key.kid = "";
+        key.kid.concat((const char*)p, kidLen);
+        p += kidLen;
+        
+        uint8_t algLen = *p++;
+        key.alg = "";
+        key.alg.concat((const char*)p, algLen);
+        p += algLen;
+        
+        memcpy(&key.expires_at, p, 4);
+        p += 4;
+        
+        uint16_t pemLen = p[0] | (p[1] << 8);
+        p += 2;
+        key.public_key_pem = "";
+        key.public_key_pem.concat((const char*)p, pemLen);
+        p += pemLen;
+        
+        count++;
+    }
+    return count;
+}
+
+bool OfflineStore::save(const OfflineWhitelist& whitelist, const JwtVerificationConfig* keys, int keyCount) {
+    if (partition == NULL) return false;
+    
+    uint8_t* keyRecords = (uint8_t*)malloc(OFFLINE_STORE_KEYS_MAX);
+    if (keyRecords == NULL) return false;
+    
+    size_t keysLength = encodeKeys(keys, keyCount, keyRecords, OFFLINE_STORE_KEYS_MAX);
+    size_t entriesLength = whitelist.size() * OfflineWhitelist::ENTRY_SIZE;
+    size_t total = OFFLINE_STORE_BODY_OFFSET + entriesLength + keysLength;
+    
+    Header next;
+    memset(&next, 0, sizeof(next));
+    next.magic = OFFLINE_STORE_MAGIC;
+    next.version = OFFLINE_STORE_VERSION;
+    next.keyCount = keyCount;
+    next.generation = header.generation + 1;
+    next.entryCount = whitelist.size();
+    next.keysOffset = OFFLINE_STORE_BODY_OFFSET + entriesLength;
+    next.keysLength = keysLength;
+    next.bodyCrc = esp_rom_crc32_le(0, (const uint8_t*)whitelist.data(), entriesLength);
+    next.bodyCrc = esp_rom_crc32_le(next.bodyCrc, keyRecords, keysLength);
+    next.headerCrc = headerCrc(next);
+    
+    // Config refreshes mostly repeat the same data, don't wear the flash for them
+    if (mapped != NULL && header.bodyCrc == next.bodyCrc && header.entryCount == next.entryCount &&
+        header.keysLength == next.keysLength) {
+        free(keyRecords);
+        return true;
+    }
+    
+    if (keysLength == 0 && keyCount > 0) {
+        LOG_E("STORE", "Key records too large");
+        free(keyRecords);
+        return false;
+    }
+    if (total > OFFLINE_STORE_SLOT_SIZE) {
+        LOG_E("STORE", "Offline data too large: %u bytes", (unsigned)total);
+        free(keyRecords);
+        return false;
+    }
+    
+    int slot = activeSlot == 0 ? 1 : 0;
+    size_t slotOffset = slot * OFFLINE_STORE_SLOT_SIZE;
+    size_t eraseSize = (total + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE;
+    uint32_t startMs = millis();
+    
+    // Body first, header last: until the header lands the slot stays invalid
+    bool ok = esp_partition_erase_range(partition, slotOffset, eraseSize) == ESP_OK &&
+              writeFromRam(slotOffset + OFFLINE_STORE_BODY_OFFSET, (const uint8_t*)whitelist.data(), entriesLength) &&
+              writeFromRam(slotOffset + next.keysOffset, keyRecords, keysLength) &&
+              esp_partition_write(partition, slotOffset, &next, sizeof(next)) == ESP_OK;
+    free(keyRecords);
+    
+    if (!ok || !mapSlot(slot, next)) {
+        LOG_E("STORE", "Failed to write offline data (slot %d)", slot);
+        return false;
+    }
+    
+    LOG_I("STORE", "Offline data gen %lu saved: %u bytes in %lums",
+          (unsigned long)next.generation, (unsigned)total, (unsigned long)(millis() - startMs));
+    return true;
+}
+
+bool OfflineStore::readHeader(int slot, Header& out) {
+    if (esp_partition_read(partition, slot * OFFLINE_STORE_SLOT_SIZE, &out, sizeof(out)) != ESP_OK) {
+        return false;
+    }
+    
+    return out.magic == OFFLINE_STORE_MAGIC && out.version == OFFLINE_STORE_VERSION &&
+           out.headerCrc == headerCrc(out) &&
+           out.keysOffset == OFFLINE_STORE_BODY_OFFSET + out.entryCount * OfflineWhitelist::ENTRY_SIZE &&
+           out.keysOffset + out.keysLength <= OFFLINE_STORE_SLOT_SIZE;
+}
+
+bool OfflineStore::mapSlot(int slot, const Header& slotHeader) {
+    const void* ptr = NULL;
+    spi_flash_mmap_handle_t handle;
+    size_t length = slotHeader.keysOffset + slotHeader.keysLength;
+    
+    esp_err_t err = esp_partition_mmap(partition, slot * OFFLINE_STORE_SLOT_SIZE, length,
+                                       SPI_FLASH_MMAP_DATA, &ptr, &handle);
+    if (err != ESP_OK) {
+        LOG_E("STORE", "mmap failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    
+    const uint8_t* base = (const uint8_t*)ptr;
+    uint32_t crc = esp_rom_crc32_le(0, base + OFFLINE_STORE_BODY_OFFSET, length - OFFLINE_STORE_BODY_OFFSET);
+    if (crc != slotHeader.bodyCrc) {
+        LOG_W("STORE", "Slot %d body CRC mismatch", slot);
+        esp_partition_munmap(handle);
+        return false;
+    }
+    
+    // Swap mappings; the caller re-attaches anything that pointed into the old one
+    unmap();
+    mapped = base;
+    mapHandle = handle;
+    activeSlot = slot;
+    header = slotHeader;
+    return true;
+}
+
+void OfflineStore::unmap() {
+    if (mapped != NULL) {
+        esp_partition_munmap(mapHandle);
+        mapped = NULL;
+    }
+}
+
+bool OfflineStore::writeFromRam(size_t offset, const uint8_t* data, size_t len) {
+    // Bounce buffer: the source may itself be mapped flash, which is not
+    // readable while the flash is being written
+    uint8_t chunk[256];
+    while (len > 0) {
+        size_t n = len > sizeof(chunk) ? sizeof(chunk) : len;
+        memcpy(chunk, data, n);
+        if (esp_partition_write(partition, offset, chunk, n) != ESP_OK) {
+            return false;
+        }
+        offset += n;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+size_t OfflineStore::encodeKeys(const JwtVerificationConfig* keys, int keyCount, uint8_t* out, size_t maxLen) {
+    size_t used = 0;
+    
+    for (int i = 0; i < keyCount; i++) {
+        const JwtVerificationConfig& key = keys[i];
+        size_t need = 1 + key.kid.length() + 1 + key.alg.length() + 4 + 2 + key.public_key_pem.length();
+        if (used + need > maxLen || key.kid.length() > 255 || key.alg.length() > 255) {
+            return 0;
+        }
+        
+        out[used++] = key.kid.length();
+        memcpy(out + used, key.kid.c_str(), key.kid.length());
+        used += key.kid.length();
+        
+        out[used++] = key.alg.length();
+        memcpy(out + used, key.alg.c_str(), key.alg.length());
+        used += key.alg.length();
+        
+        memcpy(out + used, &key.expires_at, 4);
+        used += 4;
+        
+        uint16_t pemLen = key.public_key_pem.length();
+        out[used++] = pemLen & 0xFF;
+        out[used++] = pemLen >> 8;
+        memcpy(out + used, key.public_key_pem.c_str(), pemLen);
+        used += pemLen;
+    }
+    return used;
+}
+
+uint32_t OfflineStore::headerCrc(const Header& h) {
+    return esp_rom_crc32_le(0, (const uint8_t*)&h, offsetof(Header, headerCrc));
+}
@@ -0,0 +1,239 @@
+#include "OfflineWhitelist.h"
+#include <algorithm>
+
+#define LOG_MODULE_LEVEL LOG_LEVEL_ACCESS
+#include "Log.h"
+
+// 6 KB steps: a doubling near the cap would need twice the list in one block
+#define WHITELIST_GROW_ENTRIES 512
+
+OfflineWhitelist::OfflineWhitelist()
+    : entries(NULL), view(NULL), count(0), capacity(0), outOfMemory(false) {
+    // Same bytes in RAM and in the flash partition
+    static_assert(sizeof(Entry) == ENTRY_SIZE, "whitelist entry layout");
+}
+
+OfflineWhitelist::~OfflineWhitelist() {
+    free(entries);
+}
+
+bool OfflineWhitelist::add(const char* cardId, size_t len, uint32_t validUntil) {
+    if (len == 0 || outOfMemory) return false;
+    if (entries == NULL && view != NULL) {
+        // Attached lists are read-only, start a fresh owned one
+        view = NULL;
+        count = 0;
+    }
+    
+    if (count == capacity) {
+        if (capacity >= OFFLINE_WHITELIST_MAX) {
+            return false;
+        }
+        
+        // Fixed steps while the list streams in, trimmed in finalize()
+        size_t newCapacity = capacity + WHITELIST_GROW_ENTRIES;
+        if (newCapacity > OFFLINE_WHITELIST_MAX) newCapacity = OFFLINE_WHITELIST_MAX;
+        
+        Entry* grown = (Entry*)realloc(entries, newCapacity * sizeof(Entry));
+        if (grown == NULL) {
+            // The list is incomplete from here on, see isOutOfMemory()
+            LOG_E("WHITELIST", "Out of memory at %u entries", (unsigned)count);
+            outOfMemory = true;
+            return false;
+        }
+        entries = grown;
+        capacity = newCapacity;
+    }
+    
+    uint64_t key = keyFor(cardId, len);
+    Entry& entry = entries[count++];
+    entry.keyHi = (uint32_t)(key >> 32);
+    entry.keyLo = (uint32_t)key;
+    entry.validUntil = validUntil;
+    return true;
+}
+
+void OfflineWhitelist::finalize() {
+    if (entries == NULL) return;    // Empty, or attached (already sorted)
+    
+    std::sort(entries, entries + count, less);
+    
+    // Same card listed twice: keep the later expiry (0 = never expires wins)
+    size_t out = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (out > 0 && entries[out - 1].keyHi == entries[i].keyHi && entries[out - 1].keyLo == entries[i].keyLo) {
+            Entry& kept = entries[out - 1];
+            if (kept.validUntil != 0 && (entries[i].validUntil == 0 || entries[i].validUntil > kept.validUntil)) {
+                kept.validUntil = entries[i].validUntil;
+            }
+            continue;
+        }
+        entries[out++] = entries[i];
+    }
+    count = out;
+    
+    // Give back the growth slack
+    if (count > 0 && count < capacity) {
+        Entry* trimmed = (Entry*)realloc(entries, count * sizeof(Entry));
+        if (trimmed != NULL) {
+            entries = trimmed;
+            capacity = count;
+        }
+    }
+    view = entries;
+}
+
+void OfflineWhitelist::clear() {
+    free(entries);
+    entries = NULL;
+    view = NULL;
+    count = 0;
+    capacity = 0;
+    outOfMemory = false;
+}
+
+void OfflineWhitelist::attach(const void* sortedEntries, size_t entryCount) {
+    clear();
+    view = (const Entry*)sortedEntries;
+    count = entryCount;
+}
+
+const void* OfflineWhitelist::data() const {
+    return view;
+}
+
+bool OfflineWhitelist::find(const char* cardId, size_t len, uint32_t& validUntil) const {
+    uint64_t key = keyFor(cardId, len);
+    Entry probe;
+    probe.keyHi = (uint32_t)(key >> 32);
+    probe.keyLo = (uint32_t)key;
+    
+    const Entry* it = std::lower_bound(view, view + count, probe, less);
+    if (it == view + count || it->keyHi != probe.keyHi || it->keyLo != probe.keyLo) {
+        return false;
+    }
+    
+    validUntil = it->validUntil;
+    return true;
+}
+
+void OfflineWhitelist::swap(OfflineWhitelist& other) {
+    std::swap(entries, other.entries);
+    std::swap(view, other.view);
+    std::swap(count, other.count);
+    std::swap(capacity, other.capacity);
+    std::swap(outOfMemory, other.outOfMemory);
+}
+
+size_t OfflineWhitelist::size() const {
+    return count;
+}
+
+bool OfflineWhitelist::isOutOfMemory() const {
+    return outOfMemory;
+}
+
+size_t OfflineWhitelist::memoryBytes() const {
+    return capacity * sizeof(Entry);
+}
+
+uint32_t OfflineWhitelist::parseTime(const char* text) {
+    if (text == NULL || text[0] == '\0') return 0;
+    
+    // Plain epoch seconds
+    bool digitsOnly = true;
+    for (const char* p = text; *p; p++) {
+        if (*p < '0' || *p > '9') { digitsOnly = false; break; }
+    }
+    if (digitsOnly) return strtoul(text, NULL, 10);
+    
+    int year, month, day, hour = 0, minute = 0, second = 0, used = 0;
+    if (sscanf(text, "%4d-%2d-%2d%n", &year, &month, &day, &used) < 3 ||
+        month < 1 || month > 12 || day < 1 || day > 31) {
+        return 0;
+    }
+    
+    // Time of day and UTC offset: "Z", "+07:00", "-0530" or none (taken as UTC)
+    long offset = 0;
+    const char* p = text + used;
+    if (*p == 'T' && sscanf(p, "T%2d:%2d%n", &hour, &minute, &used) == 2) {
+        p += used;
+        if (*p == ':' && sscanf(p, ":%2d%n", &second, &used) == 1) p += used;
+        if (*p == '.') {
+            // Fractional seconds, below the resolution kept here
+            p++;
+            while (*p >= '0' && *p <= '9') p++;
+        }
+        if (*p == '+' || *p == '-') {
+            int offsetHour = 0, offsetMinute = 0;
+            if (sscanf(p + 1, "%2d%n", &offsetHour, &used) != 1) return 0;
+            const char* m = p + 1 + used;
+            if (*m == ':') m++;
+            if (*m >= '0' && *m <= '9') sscanf(m, "%2d", &offsetMinute);
+            if (offsetHour > 23 || offsetMinute > 59) return 0;
+            
+            // Local time = UTC + offset
+            offset = (*p == '-' ? -1 : 1) * (offsetHour * 3600L + offsetMinute * 60L);
+        }
+    }
+    
+    // Days since 1970-01-01 (civil calendar, UTC)
+    int y = year - (month <= 2);
+    int era = y / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long days = (long)era * 146097 + doe - 719468;
+    
+    return (uint32_t)(days * 86400L + hour * 3600L + minute * 60L + second - offset);
+}
+
+void OfflineWhitelist::benchmark() {
+    static const size_t sizes[] = { 100, 1000, 5000 };
+    const int lookups = 2000;
+    char cardId[24];
+    
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        OfflineWhitelist list;
+        for (size_t i = 0; i < sizes[s]; i++) {
+            int len = snprintf(cardId, sizeof(cardId), "CARD-%06u", (unsigned)i);
+            list.add(cardId, len, 0);
+        }
+        list.finalize();
+        
+        // Key formatting alone, subtracted from the lookup loop below
+        uint32_t start = micros();
+        for (int i = 0; i < lookups; i++) {
+            snprintf(cardId, sizeof(cardId), "CARD-%06u", (unsigned)((i * 7919u) % (sizes[s] * 2)));
+        }
+        uint32_t formatUs = micros() - start;
+        
+        uint32_t validUntil;
+        int found = 0;
+        start = micros();
+        for (int i = 0; i < lookups; i++) {
+            // Half hits, half misses
+            int len = snprintf(cardId, sizeof(cardId), "CARD-%06u", (unsigned)((i * 7919u) % (sizes[s] * 2)));
+            if (list.find(cardId, len, validUntil)) found++;
+        }
+        uint32_t total = micros() - start;
+        uint32_t elapsed = total > formatUs ? total - formatUs : 0;
+        
+        LOG_I("BENCH", "Whitelist %u entries (%u bytes): %lu ns/lookup, %d hits",
+              (unsigned)list.size(), (unsigned)list.memoryBytes(),
+              (unsigned long)(elapsed * 1000UL / lookups), found);
+    }
+}
+
+uint64_t OfflineWhitelist::keyFor(const char* cardId, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)cardId[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+bool OfflineWhitelist::less(const Entry& a, const Entry& b) {
+    return a.keyHi != b.keyHi ? a.keyHi < b.keyHi : a.keyLo < b.keyLo;
+}
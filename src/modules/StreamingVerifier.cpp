@@ -0,0 +1,149 @@
+#include "StreamingVerifier.h"
+
+#define LOG_MODULE_LEVEL LOG_LEVEL_JWT
+#include "Log.h"
+
+StreamingVerifier::StreamingVerifier()
+    : state(STATE_SKIP), received(0) {
+    mbedtls_sha256_init(&sha256);
+}
+
+StreamingVerifier::~StreamingVerifier() {
+    mbedtls_sha256_free(&sha256);
+}
+
+void StreamingVerifier::begin() {
+    state = STATE_FIXED;
+    received = 0;
+    headerLen = 0;
+    payloadLen = 0;
+    payloadSeen = 0;
+    carryLen = 0;
+}
+
+void StreamingVerifier::onCredentialBytes(const uint8_t* data, size_t len) {
+    // A block can end one section and start the next
+    while (len > 0 && state != STATE_DONE && state != STATE_SKIP) {
+        size_t used = consume(data, len);
+        data += used;
+        len -= used;
+    }
+    received += len;
+}
+
+size_t StreamingVerifier::consume(const uint8_t* data, size_t len) {
+    size_t used = 0;
+    
+    switch (state) {
+        case STATE_FIXED: {
+            used = min(len, (size_t)CREDENTIAL_COMPACT_FIXED_LEN - received);
+            memcpy(fixed + received, data, used);
+            received += used;
+            if (received < CREDENTIAL_COMPACT_FIXED_LEN) break;
+            
+            headerLen = fixed[2];
+            payloadLen = fixed[3] | (fixed[4] << 8);
+            
+            // Legacy text JWTs and other algs go through the normal path
+            if (fixed[0] != CREDENTIAL_COMPACT_MAGIC || fixed[1] != CREDENTIAL_ALG_ES256 ||
+                headerLen == 0 || payloadLen == 0) {
+                state = STATE_SKIP;
+                break;
+            }
+            state = STATE_HEADER;
+            break;
+        }
+        
+        case STATE_HEADER: {
+            size_t offset = received - CREDENTIAL_COMPACT_FIXED_LEN;
+            used = min(len, (size_t)headerLen - offset);
+            memcpy(header + offset, data, used);
+            received += used;
+            if (offset + used < headerLen) break;
+            
+            startHash();
+            state = STATE_PAYLOAD;
+            break;
+        }
+        
+        case STATE_PAYLOAD: {
+            used = min(len, (size_t)(payloadLen - payloadSeen));
+            payloadSeen += used;
+            received += used;
+            
+            bool last = payloadSeen == payloadLen;
+            hashBase64(data, used, last);
+            if (last) state = STATE_DONE;
+            break;
+        }
+        
+        default:
+            used = len;
+            break;
+    }
+    
+    return used;
+}
+
+void StreamingVerifier::startHash() {
+    mbedtls_sha256_starts(&sha256, 0);
+    
+    // M = base64url(header) "." base64url(payload)
+    hashBase64(header, headerLen, true);
+    hashText(".", 1);
+}
+
+void StreamingVerifier::hashText(const char* text, size_t len) {
+    mbedtls_sha256_update(&sha256, (const uint8_t*)text, len);
+}
+
+void StreamingVerifier::hashBase64(const uint8_t* data, size_t len, bool final) {
+    char chunk[64];
+    
+    // Complete the group left over from the previous block
+    while (carryLen > 0 && carryLen < 3 && len > 0) {
+        carry[carryLen++] = *data++;
+        len--;
+    }
+    if (carryLen == 3) {
+        hashText(chunk, CredentialCodec::base64UrlEncode(carry, 3, chunk));
+        carryLen = 0;
+    }
+    
+    // Whole groups straight from the block, 48 bytes -> 64 chars per round
+    while (len >= 3) {
+        size_t n = min(len - len % 3, (size_t)48);
+        hashText(chunk, CredentialCodec::base64UrlEncode(data, n, chunk));
+        data += n;
+        len -= n;
+    }
+    
+    memcpy(carry + carryLen, data, len);
+    carryLen += len;
+    
+    // Unpadded tail at the end of a segment
+    if (final && carryLen > 0) {
+        hashText(chunk, CredentialCodec::base64UrlEncode(carry, carryLen, chunk));
+        carryLen = 0;
+    }
+}
+
+bool StreamingVerifier::finish(CardData& card) {
+    card.has_signing_digest = false;
+    
+    size_t expected = CREDENTIAL_COMPACT_FIXED_LEN + headerLen + payloadLen;
+    if (state != STATE_DONE || !card.has_credential || card.credential_bin_len != expected) {
+        // An abandoned hash would keep the SHA engine locked until the next tap
+        mbedtls_sha256_free(&sha256);
+        mbedtls_sha256_init(&sha256);
+        state = STATE_SKIP;
+        return false;
+    }
+    
+    mbedtls_sha256_finish(&sha256, card.signing_digest);
+    card.has_signing_digest = true;
+    state = STATE_SKIP;
+    
+    LOG_D("JWT", "Signing input hashed during read (%u bytes)", (unsigned)expected);
+    return true;
+}
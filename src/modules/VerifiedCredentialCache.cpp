@@ -0,0 +1,77 @@
+#include "VerifiedCredentialCache.h"
+#include <mbedtls/sha256.h>
+
+VerifiedCredentialCache::VerifiedCredentialCache()
+    : tick(0), hits(0), misses(0) {
+    clear();
+}
+
+void VerifiedCredentialCache::makeKey(const uint8_t* credential, size_t len, const String& cardUid,
+                                      const JWTPublicKey& publicKey, uint8_t outKey[VERIFIED_CACHE_KEY_LEN]) {
+    // SHA-256 is hardware accelerated on the ESP32, a few µs for a card credential
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    mbedtls_sha256_update(&ctx, credential, len);
+    mbedtls_sha256_update(&ctx, (const uint8_t*)cardUid.c_str(), cardUid.length());
+    // Bound to the key that verified it: entries of a rotated-out key never hit
+    mbedtls_sha256_update(&ctx, publicKey.key, publicKey.keyLen);
+    mbedtls_sha256_finish(&ctx, outKey);
+    mbedtls_sha256_free(&ctx);
+}
+
+bool VerifiedCredentialCache::lookup(const uint8_t key[VERIFIED_CACHE_KEY_LEN], JWTPayload& outPayload) {
+    for (int i = 0; i < OFFLINE_VERIFY_CACHE_SIZE; i++) {
+        Entry& entry = entries[i];
+        if (entry.lastUsed != 0 && memcmp(entry.key, key, VERIFIED_CACHE_KEY_LEN) == 0) {
+            entry.lastUsed = ++tick;
+            outPayload = entry.payload;
+            hits++;
+            return true;
+        }
+    }
+    
+    misses++;
+    return false;
+}
+
+void VerifiedCredentialCache::insert(const uint8_t key[VERIFIED_CACHE_KEY_LEN], const JWTPayload& payload) {
+    // Empty slot first, otherwise evict the least recently used
+    int victim = 0;
+    for (int i = 0; i < OFFLINE_VERIFY_CACHE_SIZE; i++) {
+        if (entries[i].lastUsed == 0) {
+            victim = i;
+            break;
+        }
+        if (entries[i].lastUsed < entries[victim].lastUsed) {
+            victim = i;
+        }
+    }
+    
+    Entry& entry = entries[victim];
+    memcpy(entry.key, key, VERIFIED_CACHE_KEY_LEN);
+    entry.payload = payload;
+    entry.lastUsed = ++tick;
+}
+
+void VerifiedCredentialCache::clear() {
+    for (int i = 0; i < OFFLINE_VERIFY_CACHE_SIZE; i++) {
+        entries[i].lastUsed = 0;
+    }
+}
+
+uint32_t VerifiedCredentialCache::getHits() const {
+    return hits;
+}
+
+uint32_t VerifiedCredentialCache::getMisses() const {
+    return misses;
+}
+
+int VerifiedCredentialCache::getCount() const {
+    int count = 0;
+    for (int i = 0; i < OFFLINE_VERIFY_CACHE_SIZE; i++) {
+        if (entries[i].lastUsed != 0) count++;
+    }
+    return count;
+}
@@ -0,0 +1,68 @@
+#ifndef ARDUINO_H_NATIVE_SHIM
+#define ARDUINO_H_NATIVE_SHIM
+
+// Just enough of the Arduino core for the host-side (native) tests to build
+// the platform-independent modules. Never on the include path of a device build.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <string>
+#include <chrono>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+
+inline unsigned long micros() {
+    using namespace std::chrono;
+    return (unsigned long)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+class String {
+public:
+    String(const char* text = "") : s(text ? text : "") {}
+    
+    const char* c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.length(); }
+    bool reserve(unsigned int size) { s.reserve(size); return true; }
+    
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t pos = s.find(c, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    
+    bool concat(const char* text, unsigned int len) { s.append(text, len); return true; }
+    String& operator+=(char c) { s += c; return *this; }
+    String& operator+=(const char* text) { s += text; return *this; }
+    String& operator+=(const String& other) { s += other.s; return *this; }
+    
+    char operator[](unsigned int index) const { return s[index]; }
+    bool operator==(const String& other) const { return s == other.s; }
+    bool operator==(const char* text) const { return s == text; }
+    bool operator!=(const String& other) const { return s != other.s; }
+    
+private:
+    std::string s;
+};
+
+class HardwareSerial {
+public:
+    int printf(const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        int n = vprintf(format, args);
+        va_end(args);
+        return n;
+    }
+};
+
+inline HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef MBEDTLS_SHA256_H_NATIVE_SHIM
+#define MBEDTLS_SHA256_H_NATIVE_SHIM
+
+// Portable SHA-256 behind the mbedTLS 2.x calls the firmware uses, so the
+// native tests can hash without the ESP-IDF mbedTLS component.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+struct mbedtls_sha256_context {
+    uint32_t state[8];
+    uint64_t total;
+    uint8_t buffer[64];
+};
+
+static inline uint32_t mbedtls_sha256_rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline void mbedtls_sha256_block(mbedtls_sha256_context* ctx, const uint8_t* p) {
+    static const uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+    
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)p[i * 4] << 24) | ((uint32_t)p[i * 4 + 1] << 16) |
+               ((uint32_t)p[i * 4 + 2] << 8) | (uint32_t)p[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = mbedtls_sha256_rotr(w[i - 15], 7) ^ mbedtls_sha256_rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = mbedtls_sha256_rotr(w[i - 2], 17) ^ mbedtls_sha256_rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    
+    uint32_t v[8];
+    memcpy(v, ctx->state, sizeof(v));
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = mbedtls_sha256_rotr(v[4], 6) ^ mbedtls_sha256_rotr(v[4], 11) ^ mbedtls_sha256_rotr(v[4], 25);
+        uint32_t ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+        uint32_t t1 = v[7] + s1 + ch + K[i] + w[i];
+        uint32_t s0 = mbedtls_sha256_rotr(v[0], 2) ^ mbedtls_sha256_rotr(v[0], 13) ^ mbedtls_sha256_rotr(v[0], 22);
+        uint32_t maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+        memmove(v + 1, v, 7 * sizeof(uint32_t));
+        v[4] += t1;
+        v[0] = t1 + s0 + maj;
+    }
+    for (int i = 0; i < 8; i++) {
+        ctx->state[i] += v[i];
+    }
+}
+
+static inline void mbedtls_sha256_init(mbedtls_sha256_context* ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static inline void mbedtls_sha256_free(mbedtls_sha256_context* ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+// SHA-224 is not needed by the firmware, is224 must be 0
+static inline void mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224) {
+    static const uint32_t IV[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    (void)is224;
+    memcpy(ctx->state, IV, sizeof(IV));
+    ctx->total = 0;
+}
+
+static inline void mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t len) {
+    size_t fill = ctx->total % 64;
+    ctx->total += len;
+    
+    while (len > 0) {
+        size_t n = 64 - fill < len ? 64 - fill : len;
+        memcpy(ctx->buffer + fill, input, n);
+        fill += n;
+        input += n;
+        len -= n;
+        if (fill == 64) {
+            mbedtls_sha256_block(ctx, ctx->buffer);
+            fill = 0;
+        }
+    }
+}
+
+static inline void mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char output[32]) {
+    uint64_t bits = ctx->total * 8;
+    uint8_t pad[72] = { 0x80 };
+    size_t fill = ctx->total % 64;
+    size_t padLen = (fill < 56 ? 56 : 120) - fill;
+    
+    for (int i = 0; i < 8; i++) {
+        pad[padLen + i] = (uint8_t)(bits >> (56 - i * 8));
+    }
+    mbedtls_sha256_update(ctx, pad, padLen + 8);
+    
+    for (int i = 0; i < 8; i++) {
+        output[i * 4] = (uint8_t)(ctx->state[i] >> 24);
+        output[i * 4 + 1] = (uint8_t)(ctx->state[i] >> 16);
+        output[i * 4 + 2] = (uint8_t)(ctx->state[i] >> 8);
+        output[i * 4 + 3] = (uint8_t)ctx->state[i];
+    }
+}
+
+static inline void mbedtls_sha256(const unsigned char* input, size_t len, unsigned char output[32], int is224) {
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, is224);
+    mbedtls_sha256_update(&ctx, input, len);
+    mbedtls_sha256_finish(&ctx, output);
+    mbedtls_sha256_free(&ctx);
+}
+
+#endif
@@ -0,0 +1,43 @@
+#include <unity.h>
+#include "CredentialCodec.h"
+
+static const char* const TOKEN =
+    "eyJhbGciOiJFUzI1NiIsInR5cCI6IkpXVCIsImtpZCI6ImsifQ."
+    "eyJjYXJkX2lkIjoiYSIsImNhcmRfdWlkIjoiMDEwMjAzMDQiLCJleHAiOjE4MDAwMDAwMDB9."
+    "oiNGXScmZ0ZXzNIoUJEbtzjxmNeYLq6rSuclsU5yw0KNeiU4IKHJoAMjXv6iZ4hF5HZgwicA4gKPY5KUC6sa1Q";
+
+static uint8_t compact[CREDENTIAL_MAX_BYTES];
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_round_trip() {
+    size_t len = CredentialCodec::encode(String(TOKEN), compact, sizeof(compact));
+    TEST_ASSERT_GREATER_THAN(CREDENTIAL_COMPACT_FIXED_LEN, len);
+    
+    CompactCredential cred;
+    TEST_ASSERT_TRUE(CredentialCodec::parse(compact, len, cred));
+    TEST_ASSERT_EQUAL(CREDENTIAL_ALG_ES256, cred.alg);
+    TEST_ASSERT_TRUE(CredentialCodec::toJwt(cred) == TOKEN);
+}
+
+void test_parse_needs_exact_length() {
+    size_t len = CredentialCodec::encode(String(TOKEN), compact, sizeof(compact));
+    CompactCredential cred;
+    
+    // One credential, one encoding: trailing bytes are not the same credential
+    compact[len] = 0x00;
+    TEST_ASSERT_FALSE(CredentialCodec::parse(compact, len + 1, cred));
+    TEST_ASSERT_FALSE(CredentialCodec::parse(compact, len - 1, cred));
+    TEST_ASSERT_FALSE(CredentialCodec::parse(compact, CREDENTIAL_COMPACT_FIXED_LEN, cred));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_parse_needs_exact_length);
+    return UNITY_END();
+}
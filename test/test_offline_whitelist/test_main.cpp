@@ -0,0 +1,95 @@
+#include <unity.h>
+#include "OfflineWhitelist.h"
+
+// 2025-01-31T23:59:59Z
+#define JAN31_END 1738367999UL
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_parse_time_utc() {
+    TEST_ASSERT_EQUAL(JAN31_END, OfflineWhitelist::parseTime("2025-01-31T23:59:59Z"));
+    TEST_ASSERT_EQUAL(JAN31_END, OfflineWhitelist::parseTime("2025-01-31T23:59:59.250Z"));
+    TEST_ASSERT_EQUAL(JAN31_END, OfflineWhitelist::parseTime("2025-01-31T23:59:59"));
+    TEST_ASSERT_EQUAL(JAN31_END - 86399, OfflineWhitelist::parseTime("2025-01-31"));
+    TEST_ASSERT_EQUAL(951782400UL, OfflineWhitelist::parseTime("2000-02-29T00:00:00Z"));
+}
+
+void test_parse_time_applies_offset() {
+    TEST_ASSERT_EQUAL(JAN31_END, OfflineWhitelist::parseTime("2025-02-01T06:59:59+07:00"));
+    TEST_ASSERT_EQUAL(JAN31_END, OfflineWhitelist::parseTime("2025-02-01T06:59:59+0700"));
+    TEST_ASSERT_EQUAL(JAN31_END, OfflineWhitelist::parseTime("2025-01-31T18:29:59-05:30"));
+    TEST_ASSERT_EQUAL(JAN31_END, OfflineWhitelist::parseTime("2025-02-01T06:59:59.5+07:00"));
+    TEST_ASSERT_EQUAL(JAN31_END, OfflineWhitelist::parseTime("2025-01-31T23:59:59+00:00"));
+}
+
+void test_parse_time_epoch_and_invalid() {
+    TEST_ASSERT_EQUAL(1738367999UL, OfflineWhitelist::parseTime("1738367999"));
+    TEST_ASSERT_EQUAL(0, OfflineWhitelist::parseTime(NULL));
+    TEST_ASSERT_EQUAL(0, OfflineWhitelist::parseTime(""));
+    TEST_ASSERT_EQUAL(0, OfflineWhitelist::parseTime("never"));
+    TEST_ASSERT_EQUAL(0, OfflineWhitelist::parseTime("2025-13-01T00:00:00Z"));
+    TEST_ASSERT_EQUAL(0, OfflineWhitelist::parseTime("2025-01-31T23:59:59+25:00"));
+}
+
+static bool lookup(const OfflineWhitelist& list, const char* cardId, uint32_t& validUntil) {
+    return list.find(cardId, strlen(cardId), validUntil);
+}
+
+void test_finalize_merges_duplicates() {
+    OfflineWhitelist list;
+    list.add("CARD-1", 6, 100);
+    list.add("CARD-2", 6, 500);
+    list.add("CARD-1", 6, 300);     // Later expiry wins
+    list.add("CARD-2", 6, 200);     // Earlier one does not shorten it
+    list.add("CARD-3", 6, 400);
+    list.add("CARD-3", 6, 0);       // Never expires wins
+    list.add("CARD-3", 6, 900);
+    list.finalize();
+    
+    TEST_ASSERT_EQUAL(3, list.size());
+    
+    uint32_t validUntil;
+    TEST_ASSERT_TRUE(lookup(list, "CARD-1", validUntil));
+    TEST_ASSERT_EQUAL(300, validUntil);
+    TEST_ASSERT_TRUE(lookup(list, "CARD-2", validUntil));
+    TEST_ASSERT_EQUAL(500, validUntil);
+    TEST_ASSERT_TRUE(lookup(list, "CARD-3", validUntil));
+    TEST_ASSERT_EQUAL(0, validUntil);
+    TEST_ASSERT_FALSE(lookup(list, "CARD-4", validUntil));
+}
+
+void test_finalize_across_growth_steps() {
+    OfflineWhitelist list;
+    char cardId[16];
+    
+    // Every id twice, spread over several growth steps
+    for (int pass = 0; pass < 2; pass++) {
+        for (unsigned i = 0; i < 1500; i++) {
+            int len = snprintf(cardId, sizeof(cardId), "CARD-%04u", i);
+            TEST_ASSERT_TRUE(list.add(cardId, len, pass == 0 ? i : i + 1));
+        }
+    }
+    list.finalize();
+    
+    TEST_ASSERT_EQUAL(1500, list.size());
+    TEST_ASSERT_EQUAL(1500 * OfflineWhitelist::ENTRY_SIZE, list.memoryBytes());
+    TEST_ASSERT_FALSE(list.isOutOfMemory());
+    
+    uint32_t validUntil;
+    TEST_ASSERT_TRUE(lookup(list, "CARD-0777", validUntil));
+    TEST_ASSERT_EQUAL(778, validUntil);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_parse_time_utc);
+    RUN_TEST(test_parse_time_applies_offset);
+    RUN_TEST(test_parse_time_epoch_and_invalid);
+    RUN_TEST(test_finalize_merges_duplicates);
+    RUN_TEST(test_finalize_across_growth_steps);
+    return UNITY_END();
+}
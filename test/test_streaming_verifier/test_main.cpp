@@ -0,0 +1,199 @@
+#include <unity.h>
+#include <mbedtls/sha256.h>
+#include "StreamingVerifier.h"
+#include "CredentialCodec.h"
+
+// Credentials as issued by the backend, signed with real keys
+static const char* const ES256_TOKENS[] = {
+    "eyJhbGciOiJFUzI1NiIsInR5cCI6IkpXVCIsImtpZCI6ImVzLTIwMjYtMDEifQ."
+    "eyJjYXJkX2lkIjoiYzdmM2EyZTEtNWI4ZC00YzZhLTllMmYtMWQzYjVhN2M5ZTBmIiwiY2FyZF91aWQiOiIwNEExQjJDM0Q0RTVGNiIs"
+    "InVzZXJfaWQiOiJ1LTEwMjQiLCJhY2Nlc3NfbGV2ZWwiOiJzdGFmZiIsImV4cCI6MTg5MzQ1NjAwMCwib2ZmbGluZV9tYXhfdW50aWwi"
+    "OjE4NjE5MjAwMDB9."
+    "UdEGP_UwhTNLcAcpukKdb_0vGBmldj7baVGsO32mRNsMm_TTOJWyD0YbdzyDqt6UhIP5-h6m13rlejVc8rOP6g",
+    
+    "eyJhbGciOiJFUzI1NiIsInR5cCI6IkpXVCIsImtpZCI6ImVzLTIwMjYtMDEifQ."
+    "eyJjYXJkX2lkIjoiQ0FSRC0wMDAwNDIiLCJjYXJkX3VpZCI6IkRFQURCRUVGIiwidXNlcl9pZCI6IjciLCJhY2Nlc3NfbGV2ZWwiOiJh"
+    "ZG1pbiIsImV4cCI6MTgwMDAwMDAwMH0."
+    "GOtkJzVcar6O9sF2vZYO6Ua5k_HCWn28-NUZO8bqB-I_wF_C1mgCQhoF8tVQkvIdDmnQM3Dae74JuvXS5Y5Y-Q",
+    
+    "eyJhbGciOiJFUzI1NiIsInR5cCI6IkpXVCIsImtpZCI6ImsifQ."
+    "eyJjYXJkX2lkIjoiYSIsImNhcmRfdWlkIjoiMDEwMjAzMDQiLCJleHAiOjE4MDAwMDAwMDB9."
+    "oiNGXScmZ0ZXzNIoUJEbtzjxmNeYLq6rSuclsU5yw0KNeiU4IKHJoAMjXv6iZ4hF5HZgwicA4gKPY5KUC6sa1Q",
+};
+
+static const char* const EDDSA_TOKEN =
+    "eyJhbGciOiJFZERTQSIsInR5cCI6IkpXVCIsImtpZCI6ImVkLTIwMjYtMDEifQ."
+    "eyJjYXJkX2lkIjoiYzdmM2EyZTEtNWI4ZC00YzZhLTllMmYtMWQzYjVhN2M5ZTBmIiwiY2FyZF91aWQiOiIwNEExQjJDM0Q0RTVGNiIs"
+    "InVzZXJfaWQiOiJ1LTEwMjQiLCJhY2Nlc3NfbGV2ZWwiOiJzdGFmZiIsImV4cCI6MTg5MzQ1NjAwMCwib2ZmbGluZV9tYXhfdW50aWwi"
+    "OjE4NjE5MjAwMDB9."
+    "H7p4w-oSWtaMBYATGKaDndvgANaA_twliAw3pZnvkWx9mb6BXtuMAcTJfj8fcuwM7iKWevw5deHT9iv_HAi7Ag";
+
+// Card block payload (16 bytes), the first block also carries the 2-byte length
+#define BLOCK_BYTES 16
+
+static StreamingVerifier verifier;
+static CardData card;
+static uint8_t compact[CREDENTIAL_MAX_BYTES];
+
+static size_t encodeToken(const char* jwt) {
+    size_t len = CredentialCodec::encode(String(jwt), compact, sizeof(compact));
+    TEST_ASSERT_GREATER_THAN(CREDENTIAL_COMPACT_FIXED_LEN, len);
+    return len;
+}
+
+// Feed data the way readNdefBytes() hands it over: a first chunk of
+// firstLen bytes, then whole blocks
+static void replay(const uint8_t* data, size_t len, size_t firstLen) {
+    size_t chunk = firstLen;
+    while (len > 0) {
+        size_t n = min(chunk, len);
+        verifier.onCredentialBytes(data, n);
+        data += n;
+        len -= n;
+        chunk = BLOCK_BYTES;
+    }
+}
+
+// What readCredential() leaves in the card after reading len bytes
+static void setCardRead(const uint8_t* data, size_t len) {
+    memcpy(card.credential_bin, data, len);
+    card.credential_bin_len = len;
+    card.has_credential = true;
+    card.has_signing_digest = false;
+}
+
+static void oneShotDigest(const uint8_t* data, size_t len, uint8_t digest[32]) {
+    CompactCredential cred;
+    TEST_ASSERT_TRUE(CredentialCodec::parse(data, len, cred));
+    
+    char message[CREDENTIAL_SIGNING_INPUT_MAX];
+    size_t messageLen = CredentialCodec::signingInput(cred, message, sizeof(message));
+    TEST_ASSERT_GREATER_THAN(0, messageLen);
+    
+    mbedtls_sha256((const unsigned char*)message, messageLen, digest, 0);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_sha256_known_answer() {
+    static const uint8_t expected[32] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+    };
+    uint8_t digest[32];
+    mbedtls_sha256((const unsigned char*)"abc", 3, digest, 0);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, digest, 32);
+}
+
+void test_es256_digest_matches_at_every_split() {
+    for (size_t t = 0; t < sizeof(ES256_TOKENS) / sizeof(ES256_TOKENS[0]); t++) {
+        size_t len = encodeToken(ES256_TOKENS[t]);
+        uint8_t expected[32];
+        oneShotDigest(compact, len, expected);
+        
+        // Every offset of the first block boundary, down to one byte per call
+        for (size_t firstLen = 1; firstLen <= len; firstLen++) {
+            verifier.begin();
+            replay(compact, len, firstLen);
+            setCardRead(compact, len);
+            
+            TEST_ASSERT_TRUE(verifier.finish(card));
+            TEST_ASSERT_TRUE(card.has_signing_digest);
+            TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, card.signing_digest, 32);
+        }
+    }
+}
+
+void test_eddsa_is_not_streamed() {
+    size_t len = encodeToken(EDDSA_TOKEN);
+    
+    verifier.begin();
+    replay(compact, len, BLOCK_BYTES - 2);
+    setCardRead(compact, len);
+    
+    TEST_ASSERT_FALSE(verifier.finish(card));
+    TEST_ASSERT_FALSE(card.has_signing_digest);
+}
+
+void test_text_jwt_is_not_streamed() {
+    size_t len = strlen(ES256_TOKENS[0]);
+    
+    verifier.begin();
+    replay((const uint8_t*)ES256_TOKENS[0], len, BLOCK_BYTES - 2);
+    setCardRead((const uint8_t*)ES256_TOKENS[0], len);
+    
+    TEST_ASSERT_FALSE(verifier.finish(card));
+    TEST_ASSERT_FALSE(card.has_signing_digest);
+}
+
+void test_truncated_credential_is_skipped() {
+    size_t len = encodeToken(ES256_TOKENS[0]);
+    size_t headerEnd = CREDENTIAL_COMPACT_FIXED_LEN + compact[2];
+    const size_t cuts[] = { 1, CREDENTIAL_COMPACT_FIXED_LEN - 1, CREDENTIAL_COMPACT_FIXED_LEN,
+                            headerEnd - 1, headerEnd, len - 1 };
+    
+    for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); i++) {
+        // Card left the field: fewer bytes streamed than the lengths promise
+        verifier.begin();
+        replay(compact, cuts[i], BLOCK_BYTES - 2);
+        setCardRead(compact, cuts[i]);
+        
+        TEST_ASSERT_FALSE(verifier.finish(card));
+        TEST_ASSERT_FALSE(card.has_signing_digest);
+    }
+}
+
+void test_oversized_credential_is_skipped() {
+    size_t len = encodeToken(ES256_TOKENS[1]);
+    
+    // Trailing bytes after the payload: the hash does not cover what was read
+    compact[len] = 0x00;
+    verifier.begin();
+    replay(compact, len + 1, BLOCK_BYTES - 2);
+    setCardRead(compact, len + 1);
+    TEST_ASSERT_FALSE(verifier.finish(card));
+    TEST_ASSERT_FALSE(card.has_signing_digest);
+    
+    // Payload length larger than a card can hold, never completes
+    compact[3] = 0xFF;
+    compact[4] = 0xFF;
+    verifier.begin();
+    replay(compact, len, BLOCK_BYTES - 2);
+    setCardRead(compact, len);
+    TEST_ASSERT_FALSE(verifier.finish(card));
+    TEST_ASSERT_FALSE(card.has_signing_digest);
+}
+
+void test_skip_does_not_leak_into_next_credential() {
+    size_t len = encodeToken(ES256_TOKENS[2]);
+    uint8_t expected[32];
+    oneShotDigest(compact, len, expected);
+    
+    // Abandoned halfway through the payload
+    verifier.begin();
+    replay(compact, len - 5, BLOCK_BYTES - 2);
+    setCardRead(compact, len - 5);
+    TEST_ASSERT_FALSE(verifier.finish(card));
+    
+    verifier.begin();
+    replay(compact, len, BLOCK_BYTES - 2);
+    setCardRead(compact, len);
+    TEST_ASSERT_TRUE(verifier.finish(card));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, card.signing_digest, 32);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_sha256_known_answer);
+    RUN_TEST(test_es256_digest_matches_at_every_split);
+    RUN_TEST(test_eddsa_is_not_streamed);
+    RUN_TEST(test_text_jwt_is_not_streamed);
+    RUN_TEST(test_truncated_credential_is_skipped);
+    RUN_TEST(test_oversized_credential_is_skipped);
+    RUN_TEST(test_skip_does_not_leak_into_next_credential);
+    return UNITY_END();
+}